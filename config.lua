@@ -49,6 +49,16 @@ timeBetweenExActions = 1000
 mapName = "forgotten"
 mapAuthor = "Komic"
 
+-- NOTE: denseMapStorage keeps the tiles in 32x32 blocks indexed directly by
+-- position instead of walking the map quadtree, this makes tile lookups
+-- faster on large, densely mapped worlds at the cost of some memory
+denseMapStorage = false
+
+-- NOTE: worldCache writes the loaded map, spawns and houses to
+-- data/world/mapName.cache and reuses it on the next start as long as the
+-- map, items.otb, items.xml, spawn and house files did not change
+worldCache = false
+
 -- Market
 marketOfferDuration = 30 * 24 * 60 * 60
 premiumToCreateMarketOffer = true
@@ -96,6 +106,25 @@ convertUnsafeScripts = true
 defaultPriority = "high"
 startupDatabaseOptimization = false
 
+-- Game loop
+-- NOTE: gameTickInterval set to 0 runs every task as soon as it arrives,
+-- any other value (e.g. 50) runs the game in fixed ticks of that many
+-- milliseconds: network input, creature think, walk, decay, other events
+-- and then one output flush per tick
+gameTickInterval = 0
+
+-- NOTE: taskStatsLogInterval is in seconds, set it to 0 to disable writing
+-- dispatcher and scheduler statistics to data/logs/taskstats.log
+taskStatsLogInterval = 0
+
+-- NOTE: pathfinderThreads is the number of threads that search the follow
+-- paths of monsters away from the game thread, 0 searches them right away
+pathfinderThreads = 0
+
+-- NOTE: networkThreads is the number of threads that read, write and
+-- encrypt the packets of the connections, 0 uses one per CPU core
+networkThreads = 0
+
 -- Status server information
 ownerName = ""
 ownerEmail = ""
@@ -9,7 +9,7 @@ function onSay(player, words, param)
 
 	local itemCount = cleanMap()
 	if itemCount > 0 then
-		player:sendTextMessage(MESSAGE_STATUS_WARNING, "Cleaned " .. itemCount .. " item" .. (itemCount > 1 and "s" or "") .. " from the map.")
+		player:sendTextMessage(MESSAGE_STATUS_WARNING, "Cleaning " .. itemCount .. " item" .. (itemCount > 1 and "s" or "") .. " from the map...")
 	end
 	return false
 end
@@ -0,0 +1,18 @@
+function onSay(player, words, param)
+	if not player:getGroup():getAccess() then
+		return true
+	end
+
+	if player:getAccountType() < ACCOUNT_TYPE_GOD then
+		return false
+	end
+
+	if param == "reset" then
+		Game.resetTaskStats()
+		player:sendTextMessage(MESSAGE_STATUS_CONSOLE_BLUE, "Task statistics have been reset.")
+		return false
+	end
+
+	player:sendTextMessage(MESSAGE_STATUS_CONSOLE_BLUE, Game.getTaskStats())
+	return false
+end
@@ -55,6 +55,8 @@ bool ConfigManager::load()
 	if (!loaded) { //info that must be loaded one time (unless we reset the modules involved)
 		boolean[BIND_ONLY_GLOBAL_ADDRESS] = getGlobalBoolean(L, "bindOnlyGlobalAddress", false);
 		boolean[OPTIMIZE_DATABASE] = getGlobalBoolean(L, "startupDatabaseOptimization", true);
+		boolean[DENSE_MAP_STORAGE] = getGlobalBoolean(L, "denseMapStorage", false);
+		boolean[WORLD_CACHE] = getGlobalBoolean(L, "worldCache", false);
 
 		string[IP] = getGlobalString(L, "ip", "127.0.0.1");
 		string[MAP_NAME] = getGlobalString(L, "mapName", "forgotten");
@@ -70,6 +72,9 @@ bool ConfigManager::load()
 		integer[GAME_PORT] = getGlobalNumber(L, "gameProtocolPort", 7172);
 		integer[LOGIN_PORT] = getGlobalNumber(L, "loginProtocolPort", 7171);
 		integer[STATUS_PORT] = getGlobalNumber(L, "statusProtocolPort", 7171);
+		integer[GAME_TICK_INTERVAL] = getGlobalNumber(L, "gameTickInterval", 0);
+		integer[PATHFINDER_THREADS] = getGlobalNumber(L, "pathfinderThreads", 0);
+		integer[NETWORK_THREADS] = getGlobalNumber(L, "networkThreads", 0);
 	}
 
 	boolean[ALLOW_CHANGEOUTFIT] = getGlobalBoolean(L, "allowChangeOutfit", true);
@@ -119,6 +124,7 @@ bool ConfigManager::load()
 	integer[STAIRHOP_DELAY] = getGlobalNumber(L, "stairJumpExhaustion", 2000);
 	integer[EXP_FROM_PLAYERS_LEVEL_RANGE] = getGlobalNumber(L, "expFromPlayersLevelRange", 75);
 	integer[MAX_PACKETS_PER_SECOND] = getGlobalNumber(L, "maxPacketsPerSecond", 25);
+	integer[TASK_STATS_LOG_INTERVAL] = getGlobalNumber(L, "taskStatsLogInterval", 0);
 
 	loaded = true;
 	lua_close(L);
@@ -43,6 +43,8 @@ class ConfigManager
 			WARN_UNSAFE_SCRIPTS,
 			CONVERT_UNSAFE_SCRIPTS,
 			CLASSIC_EQUIPMENT_SLOTS,
+			DENSE_MAP_STORAGE,
+			WORLD_CACHE,
 
 			LAST_BOOLEAN_CONFIG /* this must be the last one */
 		};
@@ -99,6 +101,10 @@ class ConfigManager
 			STAIRHOP_DELAY,
 			EXP_FROM_PLAYERS_LEVEL_RANGE,
 			MAX_PACKETS_PER_SECOND,
+			GAME_TICK_INTERVAL,
+			TASK_STATS_LOG_INTERVAL,
+			PATHFINDER_THREADS,
+			NETWORK_THREADS,
 
 			LAST_INTEGER_CONFIG /* this must be the last one */
 		};
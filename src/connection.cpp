@@ -113,6 +113,7 @@ void Connection::closeSocket()
 	if (m_socket->is_open()) {
 		m_pendingRead = 0;
 		m_pendingWrite = 0;
+		m_messageQueue.clear();
 
 		try {
 			boost::system::error_code error;
@@ -330,29 +331,46 @@ bool Connection::send(OutputMessage_ptr msg)
 		return false;
 	}
 
+	msg->getProtocol()->onSendMessage(msg);
+	m_messageQueue.push_back(msg);
+
+	// anything queued while a write is in flight goes out with the next batch
 	if (m_pendingWrite == 0) {
-		msg->getProtocol()->onSendMessage(msg);
-		internalSend(msg);
-	} else {
-		// FIXME: This results in packets being sent in wrong order, all queued
-		// packets to the same connection should also be moved to auto send.
-		OutputMessagePool::getInstance()->addToAutoSend(msg);
+		++m_pendingWrite;
+		m_io_service.post(std::bind(&Connection::internalSend, shared_from_this()));
 	}
-
 	return true;
 }
 
-void Connection::internalSend(OutputMessage_ptr msg)
+void Connection::internalSend()
 {
+	//io_service thread
+	m_connectionLock.lock();
+	if (m_messageQueue.empty()) {
+		// the socket was closed in the meantime
+		m_connectionLock.unlock();
+		return;
+	}
+	m_writeBatch.swap(m_messageQueue);
+	m_connectionLock.unlock();
+
+	// only this thread touches the batch until the write completes
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.reserve(m_writeBatch.size());
+	for (const OutputMessage_ptr& msg : m_writeBatch) {
+		Protocol::encodeMessage(*msg);
+		buffers.emplace_back(msg->getOutputBuffer(), msg->getLength());
+	}
+
+	std::lock_guard<std::recursive_mutex> lockClass(m_connectionLock);
+
 	try {
-		++m_pendingWrite;
 		m_writeTimer.expires_from_now(boost::posix_time::seconds(Connection::write_timeout));
 		m_writeTimer.async_wait( std::bind(&Connection::handleWriteTimeout, std::weak_ptr<Connection>(shared_from_this()),
 		                                     std::placeholders::_1));
 
-		boost::asio::async_write(getHandle(),
-		                         boost::asio::buffer(msg->getOutputBuffer(), msg->getLength()),
-		                         std::bind(&Connection::onWriteOperation, shared_from_this(), msg, std::placeholders::_1));
+		boost::asio::async_write(getHandle(), buffers,
+		                         std::bind(&Connection::onWriteOperation, shared_from_this(), std::placeholders::_1));
 	} catch (boost::system::system_error& e) {
 		if (m_logError) {
 			std::cout << "[Network error - Connection::internalSend] " << e.what() << std::endl;
@@ -374,18 +392,26 @@ uint32_t Connection::getIP() const
 	return htonl(endpoint.address().to_v4().to_ulong());
 }
 
-void Connection::onWriteOperation(OutputMessage_ptr msg, const boost::system::error_code& error)
+void Connection::onWriteOperation(const boost::system::error_code& error)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(m_connectionLock);;
+	std::unique_lock<std::recursive_mutex> lockClass(m_connectionLock);
 	m_writeTimer.cancel();
 
-	msg.reset();
+	m_writeBatch.clear();
 
 	if (error) {
 		handleWriteError(error);
 	}
 
+	// keep flushing while closing so that the last packets (e.g. a disconnect reason) still arrive
+	if (!m_writeError && !m_messageQueue.empty() && m_socket->is_open()) {
+		lockClass.unlock();
+		internalSend();
+		return;
+	}
+
 	if (m_connectionState != CONNECTION_STATE_OPEN || m_writeError) {
+		m_messageQueue.clear();
 		closeSocket();
 		close();
 		return;
@@ -22,11 +22,15 @@
 
 #include <unordered_set>
 
+#include <boost/intrusive_ptr.hpp>
+
 #include "networkmessage.h"
 
 class Protocol;
 class OutputMessage;
-typedef std::shared_ptr<OutputMessage> OutputMessage_ptr;
+typedef boost::intrusive_ptr<OutputMessage> OutputMessage_ptr;
+void intrusive_ptr_add_ref(OutputMessage* msg);
+void intrusive_ptr_release(OutputMessage* msg);
 class Connection;
 typedef std::shared_ptr<Connection> Connection_ptr;
 class ServiceBase;
@@ -117,7 +121,7 @@ class Connection : public std::enable_shared_from_this<Connection>
 		void parseHeader(const boost::system::error_code& error);
 		void parsePacket(const boost::system::error_code& error);
 
-		void onWriteOperation(OutputMessage_ptr msg, const boost::system::error_code& error);
+		void onWriteOperation(const boost::system::error_code& error);
 
 		void onStopOperation();
 		void handleReadError(const boost::system::error_code& error);
@@ -133,10 +137,14 @@ class Connection : public std::enable_shared_from_this<Connection>
 		void onReadTimeout();
 		void onWriteTimeout();
 
-		void internalSend(OutputMessage_ptr msg);
+		void internalSend();
 
 		NetworkMessage m_msg;
 
+		// messages waiting for the write in flight, and the batch being written
+		std::vector<OutputMessage_ptr> m_messageQueue;
+		std::vector<OutputMessage_ptr> m_writeBatch;
+
 		boost::asio::deadline_timer m_readTimer;
 		boost::asio::deadline_timer m_writeTimer;
 
@@ -150,7 +158,7 @@ class Connection : public std::enable_shared_from_this<Connection>
 
 		time_t m_timeConnected;
 		uint32_t m_packetsSent;
-		uint32_t m_refCount;
+		std::atomic<uint32_t> m_refCount;
 		int32_t m_pendingWrite;
 		int32_t m_pendingRead;
 		ConnectionState_t m_connectionState;
@@ -164,6 +164,7 @@ class Container : public Item, public Cylinder
 
 		friend class ContainerIterator;
 		friend class IOMapSerialize;
+		friend class WorldCache;
 };
 
 #endif
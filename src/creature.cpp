@@ -29,6 +29,7 @@
 #include "combat.h"
 #include "configmanager.h"
 #include "scheduler.h"
+#include "pathfinder.h"
 
 double Creature::speedA = 857.36;
 double Creature::speedB = 261.29;
@@ -39,7 +40,7 @@ extern ConfigManager g_config;
 extern CreatureEvents* g_creatureEvents;
 
 Creature::Creature() :
-	localMapCache(), isInternalRemoved(false)
+	isInternalRemoved(false)
 {
 	referenceCounter = 0;
 
@@ -65,6 +66,7 @@ Creature::Creature() :
 	cancelNextWalk = false;
 	forceUpdateFollowPath = false;
 	isMapLoaded = false;
+	updateMapCache();
 	isUpdatingPath = false;
 
 	attackedCreature = nullptr;
@@ -73,6 +75,7 @@ Creature::Creature() :
 	blockCount = 0;
 	blockTicks = 0;
 	walkUpdateTicks = 0;
+	pathRequestId = 0;
 	creatureCheck = false;
 	inCheckCreaturesVector = false;
 	scriptEventsBitField = 0;
@@ -327,7 +330,7 @@ void Creature::addEventWalk(bool firstStep)
 		g_game.checkCreatureWalk(getID());
 	}
 
-	eventWalk = g_scheduler.addEvent(createSchedulerTask(ticks, std::bind(&Game::checkCreatureWalk, &g_game, getID())));
+	eventWalk = g_scheduler.addEvent(createSchedulerTask(ticks, std::bind(&Game::checkCreatureWalk, &g_game, getID()), TASK_ORIGIN_CREATURE_WALK));
 }
 
 void Creature::stopEventWalk()
@@ -340,34 +343,47 @@ void Creature::stopEventWalk()
 
 void Creature::updateMapCache()
 {
-	Tile* tile;
-	const Position& myPos = getPosition();
-	Position pos(0, 0, myPos.z);
+	// every position is checked again the first time a path search asks for it
+	memset(localMapCache, 2, sizeof(localMapCache));
+}
 
-	for (int32_t y = -maxWalkCacheHeight; y <= maxWalkCacheHeight; ++y) {
-		for (int32_t x = -maxWalkCacheWidth; x <= maxWalkCacheWidth; ++x) {
-			pos.x = myPos.getX() + x;
-			pos.y = myPos.getY() + y;
-			tile = g_game.map.getTile(pos);
-			updateTileCache(tile, pos);
-		}
+void Creature::shiftMapCache(int32_t dx, int32_t dy)
+{
+	if (std::abs(dx) >= mapWalkWidth || std::abs(dy) >= mapWalkHeight) {
+		updateMapCache();
+		return;
+	}
+
+	// keep what is still in range, only the uncovered rows and columns are new
+	uint8_t shifted[mapWalkHeight][mapWalkWidth];
+	memset(shifted, 2, sizeof(shifted));
+
+	for (int32_t y = std::max<int32_t>(0, -dy), endY = std::min<int32_t>(mapWalkHeight, mapWalkHeight - dy); y < endY; ++y) {
+		int32_t startX = std::max<int32_t>(0, -dx);
+		int32_t endX = std::min<int32_t>(mapWalkWidth, mapWalkWidth - dx);
+		memcpy(&shifted[y][startX], &localMapCache[y + dy][startX + dx], endX - startX);
 	}
+	memcpy(localMapCache, shifted, sizeof(localMapCache));
 }
 
-void Creature::updateTileCache(const Tile* tile, int32_t dx, int32_t dy)
+void Creature::updateTileCache(int32_t dx, int32_t dy) const
 {
-	if (std::abs(dx) <= maxWalkCacheWidth && std::abs(dy) <= maxWalkCacheHeight) {
-		localMapCache[maxWalkCacheHeight + dy][maxWalkCacheWidth + dx] = tile && tile->queryAdd(0, *this, 1, FLAG_PATHFINDING | FLAG_IGNOREFIELDDAMAGE) == RETURNVALUE_NOERROR;
-	}
+	const Position& myPos = getPosition();
+	Position pos(myPos.x + dx, myPos.y + dy, myPos.z);
+	const Tile* tile = g_game.map.getTile(pos);
+	localMapCache[maxWalkCacheHeight + dy][maxWalkCacheWidth + dx] = tile && !g_game.map.isPathBlocked(*this, pos) &&
+		tile->queryAdd(0, *this, 1, FLAG_PATHFINDING | FLAG_IGNOREFIELDDAMAGE) == RETURNVALUE_NOERROR;
 }
 
-void Creature::updateTileCache(const Tile* tile, const Position& pos)
+void Creature::invalidateTileCache(const Position& pos)
 {
 	const Position& myPos = getPosition();
 	if (pos.z == myPos.z) {
 		int32_t dx = Position::getOffsetX(pos, myPos);
 		int32_t dy = Position::getOffsetY(pos, myPos);
-		updateTileCache(tile, dx, dy);
+		if (std::abs(dx) <= maxWalkCacheWidth && std::abs(dy) <= maxWalkCacheHeight) {
+			localMapCache[maxWalkCacheHeight + dy][maxWalkCacheWidth + dx] = 2;
+		}
 	}
 }
 
@@ -390,11 +406,11 @@ int32_t Creature::getWalkCache(const Position& pos) const
 	if (std::abs(dx) <= maxWalkCacheWidth) {
 		int32_t dy = Position::getOffsetY(pos, myPos);
 		if (std::abs(dy) <= maxWalkCacheHeight) {
-			if (localMapCache[maxWalkCacheHeight + dy][maxWalkCacheWidth + dx]) {
-				return 1;
-			} else {
-				return 0;
+			uint8_t& cache = localMapCache[maxWalkCacheHeight + dy][maxWalkCacheWidth + dx];
+			if (cache == 2) {
+				updateTileCache(dx, dy);
 			}
+			return cache;
 		}
 	}
 
@@ -402,14 +418,14 @@ int32_t Creature::getWalkCache(const Position& pos) const
 	return 2;
 }
 
-void Creature::onAddTileItem(const Tile* tile, const Position& pos)
+void Creature::onAddTileItem(const Tile*, const Position& pos)
 {
-	if (isMapLoaded && pos.z == getPosition().z) {
-		updateTileCache(tile, pos);
+	if (isMapLoaded) {
+		invalidateTileCache(pos);
 	}
 }
 
-void Creature::onUpdateTileItem(const Tile* tile, const Position& pos, const Item*,
+void Creature::onUpdateTileItem(const Tile*, const Position& pos, const Item*,
                                 const ItemType& oldType, const Item*, const ItemType& newType)
 {
 	if (!isMapLoaded) {
@@ -417,22 +433,18 @@ void Creature::onUpdateTileItem(const Tile* tile, const Position& pos, const Ite
 	}
 
 	if (oldType.blockSolid || oldType.blockPathFind || newType.blockPathFind || newType.blockSolid) {
-		if (pos.z == getPosition().z) {
-			updateTileCache(tile, pos);
-		}
+		invalidateTileCache(pos);
 	}
 }
 
-void Creature::onRemoveTileItem(const Tile* tile, const Position& pos, const ItemType& iType, const Item*)
+void Creature::onRemoveTileItem(const Tile*, const Position& pos, const ItemType& iType, const Item*)
 {
 	if (!isMapLoaded) {
 		return;
 	}
 
 	if (iType.blockSolid || iType.blockPathFind || iType.isGroundTile()) {
-		if (pos.z == getPosition().z) {
-			updateTileCache(tile, pos);
-		}
+		invalidateTileCache(pos);
 	}
 }
 
@@ -444,9 +456,7 @@ void Creature::onCreatureAppear(Creature* creature, bool)
 			updateMapCache();
 		}
 	} else if (isMapLoaded) {
-		if (creature->getPosition().z == getPosition().z) {
-			updateTileCache(creature->getTile(), creature->getPosition());
-		}
+		invalidateTileCache(creature->getPosition());
 	}
 }
 
@@ -458,9 +468,7 @@ void Creature::onRemoveCreature(Creature* creature, bool)
 			master->removeSummon(this);
 		}
 	} else if (isMapLoaded) {
-		if (creature->getPosition().z == getPosition().z) {
-			updateTileCache(creature->getTile(), creature->getPosition());
-		}
+		invalidateTileCache(creature->getPosition());
 	}
 }
 
@@ -531,100 +539,16 @@ void Creature::onCreatureMove(Creature* creature, const Tile* newTile, const Pos
 
 		//update map cache
 		if (isMapLoaded) {
-			if (teleport || oldPos.z != newPos.z) {
+			if (oldPos.z != newPos.z) {
 				updateMapCache();
 			} else {
-				Tile* tile;
-				const Position& myPos = getPosition();
-				Position pos;
-
-				if (oldPos.y > newPos.y) { //north
-					//shift y south
-					for (int32_t y = mapWalkHeight - 1; --y >= 0;) {
-						memcpy(localMapCache[y + 1], localMapCache[y], sizeof(localMapCache[y]));
-					}
-
-					//update 0
-					for (int32_t x = -maxWalkCacheWidth; x <= maxWalkCacheWidth; ++x) {
-						tile = g_game.map.getTile(myPos.getX() + x, myPos.getY() - maxWalkCacheHeight, myPos.z);
-						updateTileCache(tile, x, -maxWalkCacheHeight);
-					}
-				} else if (oldPos.y < newPos.y) { // south
-					//shift y north
-					for (int32_t y = 0; y <= mapWalkHeight - 2; ++y) {
-						memcpy(localMapCache[y], localMapCache[y + 1], sizeof(localMapCache[y]));
-					}
-
-					//update mapWalkHeight - 1
-					for (int32_t x = -maxWalkCacheWidth; x <= maxWalkCacheWidth; ++x) {
-						tile = g_game.map.getTile(myPos.getX() + x, myPos.getY() + maxWalkCacheHeight, myPos.z);
-						updateTileCache(tile, x, maxWalkCacheHeight);
-					}
-				}
-
-				if (oldPos.x < newPos.x) { // east
-					//shift y west
-					int32_t starty = 0;
-					int32_t endy = mapWalkHeight - 1;
-					int32_t dy = Position::getDistanceY(oldPos, newPos);
-
-					if (dy < 0) {
-						endy += dy;
-					} else if (dy > 0) {
-						starty = dy;
-					}
-
-					for (int32_t y = starty; y <= endy; ++y) {
-						for (int32_t x = 0; x <= mapWalkWidth - 2; ++x) {
-							localMapCache[y][x] = localMapCache[y][x + 1];
-						}
-					}
-
-					//update mapWalkWidth - 1
-					for (int32_t y = -maxWalkCacheHeight; y <= maxWalkCacheHeight; ++y) {
-						tile = g_game.map.getTile(myPos.x + maxWalkCacheWidth, myPos.y + y, myPos.z);
-						updateTileCache(tile, maxWalkCacheWidth, y);
-					}
-				} else if (oldPos.x > newPos.x) { // west
-					//shift y east
-					int32_t starty = 0;
-					int32_t endy = mapWalkHeight - 1;
-					int32_t dy = Position::getDistanceY(oldPos, newPos);
-
-					if (dy < 0) {
-						endy += dy;
-					} else if (dy > 0) {
-						starty = dy;
-					}
-
-					for (int32_t y = starty; y <= endy; ++y) {
-						for (int32_t x = mapWalkWidth - 1; --x >= 0;) {
-							localMapCache[y][x + 1] = localMapCache[y][x];
-						}
-					}
-
-					//update 0
-					for (int32_t y = -maxWalkCacheHeight; y <= maxWalkCacheHeight; ++y) {
-						tile = g_game.map.getTile(myPos.x - maxWalkCacheWidth, myPos.y + y, myPos.z);
-						updateTileCache(tile, -maxWalkCacheWidth, y);
-					}
-				}
-
-				updateTileCache(oldTile, oldPos);
-			}
-		}
-	} else {
-		if (isMapLoaded) {
-			const Position& myPos = getPosition();
-
-			if (newPos.z == myPos.z) {
-				updateTileCache(newTile, newPos);
-			}
-
-			if (oldPos.z == myPos.z) {
-				updateTileCache(oldTile, oldPos);
+				shiftMapCache(Position::getOffsetX(newPos, oldPos), Position::getOffsetY(newPos, oldPos));
+				invalidateTileCache(oldPos);
 			}
 		}
+	} else if (isMapLoaded) {
+		invalidateTileCache(newPos);
+		invalidateTileCache(oldPos);
 	}
 
 	if (creature == followCreature || (creature == this && followCreature)) {
@@ -914,6 +838,9 @@ void Creature::getPathSearchParams(const Creature*, FindPathParams& fpp) const
 
 void Creature::goToFollowCreature()
 {
+	// whatever is still being searched for this creature is outdated now
+	++pathRequestId;
+
 	if (followCreature) {
 		FindPathParams fpp;
 		getPathSearchParams(followCreature, fpp);
@@ -928,6 +855,10 @@ void Creature::goToFollowCreature()
 				if (!monster->getDistanceStep(followCreature->getPosition(), dir)) {
 					// if we can't get anything then let the A* calculate
 					listWalkDir.clear();
+					if (g_pathfinder.requestPath(*this, followCreature->getPosition(), fpp)) {
+						return;
+					}
+
 					if (getPathTo(followCreature->getPosition(), listWalkDir, fpp)) {
 						hasFollowPath = true;
 						startAutoWalk(listWalkDir);
@@ -948,7 +879,12 @@ void Creature::goToFollowCreature()
 			}
 		} else {
 			listWalkDir.clear();
-			if (getPathTo(followCreature->getPosition(), listWalkDir, fpp)) {
+			bool found = g_game.map.getFollowPath(*this, *followCreature, listWalkDir, fpp);
+			if (!found && g_pathfinder.requestPath(*this, followCreature->getPosition(), fpp)) {
+				return;
+			}
+
+			if (found || getPathTo(followCreature->getPosition(), listWalkDir, fpp)) {
 				hasFollowPath = true;
 				startAutoWalk(listWalkDir);
 			} else {
@@ -960,6 +896,28 @@ void Creature::goToFollowCreature()
 	onFollowCreatureComplete(followCreature);
 }
 
+void Creature::onPathFound(uint32_t requestId, const Position& startPos, bool found, const std::forward_list<Direction>& dirList)
+{
+	if (requestId != pathRequestId || !followCreature || isRemoved()) {
+		return;
+	}
+
+	// the path starts where the search started, try again from here
+	if (getPosition() != startPos) {
+		forceUpdateFollowPath = true;
+		return;
+	}
+
+	if (found) {
+		hasFollowPath = true;
+		startAutoWalk(dirList);
+	} else {
+		hasFollowPath = false;
+	}
+
+	onFollowCreatureComplete(followCreature);
+}
+
 bool Creature::setFollowCreature(Creature* creature)
 {
 	if (creature) {
@@ -1588,7 +1546,11 @@ bool FrozenPathingConditionCall::operator()(const Position& startPos, const Posi
 	if (fpp.clearSight && !g_game.isSightClear(testPos, targetPos, true)) {
 		return false;
 	}
+	return isDistanceMatch(testPos, fpp, bestMatchDist);
+}
 
+bool FrozenPathingConditionCall::isDistanceMatch(const Position& testPos, const FindPathParams& fpp, int32_t& bestMatchDist) const
+{
 	int32_t testDist = std::max<int32_t>(Position::getDistanceX(targetPos, testPos), Position::getDistanceY(targetPos, testPos));
 	if (fpp.maxTargetDist == 1) {
 		if (testDist < fpp.minTargetDist || testDist > fpp.maxTargetDist) {
@@ -1622,6 +1584,9 @@ bool Creature::isInvisible() const
 
 bool Creature::getPathTo(const Position& targetPos, std::forward_list<Direction>& dirList, const FindPathParams& fpp) const
 {
+	if (g_game.map.getLongPath(*this, targetPos, dirList, fpp)) {
+		return true;
+	}
 	return g_game.map.getPathMatching(*this, dirList, FrozenPathingConditionCall(targetPos), fpp);
 }
 
@@ -91,6 +91,11 @@ class FrozenPathingConditionCall
 
 		bool isInRange(const Position& startPos, const Position& testPos,
 		               const FindPathParams& fpp) const;
+		bool isDistanceMatch(const Position& testPos, const FindPathParams& fpp, int32_t& bestMatchDist) const;
+
+		const Position& getTargetPos() const {
+			return targetPos;
+		}
 
 	protected:
 		Position targetPos;
@@ -262,6 +267,10 @@ class Creature : virtual public Thing
 		void addEventWalk(bool firstStep = false);
 		void stopEventWalk();
 		virtual void goToFollowCreature();
+		void onPathFound(uint32_t requestId, const Position& startPos, bool found, const std::forward_list<Direction>& dirList);
+		uint32_t getPathRequestId() const {
+			return pathRequestId;
+		}
 
 		//walk events
 		virtual void onWalk(Direction& dir);
@@ -501,6 +510,7 @@ class Creature : virtual public Thing
 		uint32_t scriptEventsBitField;
 		uint32_t eventWalk;
 		uint32_t walkUpdateTicks;
+		uint32_t pathRequestId;
 		uint32_t lastHitCreature;
 		uint32_t blockCount;
 		uint32_t blockTicks;
@@ -519,7 +529,8 @@ class Creature : virtual public Thing
 		Direction direction;
 		Skulls_t skull;
 
-		bool localMapCache[mapWalkHeight][mapWalkWidth];
+		// 0 blocked, 1 walkable, 2 changed since the last check, see getWalkCache
+		mutable uint8_t localMapCache[mapWalkHeight][mapWalkWidth];
 		bool isInternalRemoved;
 		bool isMapLoaded;
 		bool isUpdatingPath;
@@ -539,8 +550,9 @@ class Creature : virtual public Thing
 		CreatureEventList getCreatureEvents(CreatureEventType_t type);
 
 		void updateMapCache();
-		void updateTileCache(const Tile* tile, int32_t dx, int32_t dy);
-		void updateTileCache(const Tile* tile, const Position& pos);
+		void shiftMapCache(int32_t dx, int32_t dy);
+		void updateTileCache(int32_t dx, int32_t dy) const;
+		void invalidateTileCache(const Position& pos);
 		void onCreatureDisappear(const Creature* creature, bool isLogout);
 		virtual void doAttacking(uint32_t) {}
 		virtual bool hasExtraSwing() {
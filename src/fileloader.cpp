@@ -19,176 +19,138 @@
 
 #include "otpch.h"
 
-#include "fileloader.h"
+#include <boost/iostreams/device/mapped_file.hpp>
 
-FileLoader::FileLoader() : m_cached_data()
-{
-	m_file = nullptr;
-	m_root = nullptr;
-	m_buffer = new uint8_t[1024];
-	m_buffer_size = 1024;
-	m_lastError = ERROR_NONE;
-
-	//cache
-	m_cache_size = 0;
-	m_cache_index = NO_VALID_CACHE;
-	m_cache_offset = NO_VALID_CACHE;
-}
+#include "fileloader.h"
 
-FileLoader::~FileLoader()
-{
-	if (m_file) {
-		fclose(m_file);
-		m_file = nullptr;
-	}
+FileLoader::FileLoader() : m_data(nullptr), m_size(0), m_root(nullptr), m_lastError(ERROR_NONE) {}
 
-	NodeStruct::clearNet(m_root);
-	delete[] m_buffer;
-
-	for (int32_t i = 0; i < CACHE_BLOCKS; i++) {
-		delete[] m_cached_data[i].data;
-	}
-}
+FileLoader::~FileLoader() = default;
 
 bool FileLoader::openFile(const char* filename, const char* accept_identifier)
 {
-	m_file = fopen(filename, "rb");
-	if (!m_file) {
+	try {
+		m_file.reset(new boost::iostreams::mapped_file_source(filename));
+	} catch (const std::exception&) {
+		m_file.reset();
 		m_lastError = ERROR_CAN_NOT_OPEN;
 		return false;
 	}
 
-	char identifier[4];
-	if (fread(identifier, 1, 4, m_file) < 4) {
-		fclose(m_file);
-		m_file = nullptr;
+	m_data = reinterpret_cast<const uint8_t*>(m_file->data());
+	m_size = m_file->size();
+	if (m_size < 4) {
 		m_lastError = ERROR_EOF;
 		return false;
 	}
 
+	if (m_size > std::numeric_limits<uint32_t>::max()) {
+		m_lastError = ERROR_INVALID_FORMAT;
+		return false;
+	}
+
 	// The first four bytes must either match the accept identifier or be 0x00000000 (wildcard)
-	if (memcmp(identifier, accept_identifier, 4) != 0 && memcmp(identifier, "\0\0\0\0", 4) != 0) {
-		fclose(m_file);
-		m_file = nullptr;
+	if (memcmp(m_data, accept_identifier, 4) != 0 && memcmp(m_data, "\0\0\0\0", 4) != 0) {
 		m_lastError = ERROR_INVALID_FILE_VERSION;
 		return false;
 	}
 
-	fseek(m_file, 0, SEEK_END);
-	int32_t file_size = ftell(m_file);
-	m_cache_size = std::min<uint32_t>(32768, std::max<uint32_t>(file_size / 20, 8192)) & ~0x1FFF;
-
-	if (!safeSeek(4)) {
+	if (m_size < 6 || m_data[4] != NODE_START) {
 		m_lastError = ERROR_INVALID_FORMAT;
 		return false;
 	}
 
-	delete m_root;
-	m_root = new NodeStruct();
-	m_root->start = 4;
-
-	int32_t byte;
-	if (safeSeek(4) && readByte(byte) && byte == NODE_START) {
-		return parseNode(m_root);
-	}
-
-	return false;
+	return parseNodes();
 }
 
-bool FileLoader::parseNode(NODE node)
+void FileLoader::openFile(const FileLoader& source)
 {
-	int32_t byte, pos;
-	NODE currentNode = node;
-
-	while (readByte(byte)) {
-		currentNode->type = byte;
-		bool setPropsSize = false;
-
-		while (true) {
-			if (!readByte(byte)) {
-				return false;
-			}
-
-			bool skipNode = false;
-
-			switch (byte) {
-				case NODE_START: {
-					//child node start
-					if (!safeTell(pos)) {
-						return false;
-					}
-
-					NODE childNode = new NodeStruct();
-					childNode->start = pos;
-					currentNode->propsSize = pos - currentNode->start - 2;
-					currentNode->child = childNode;
-
-					setPropsSize = true;
-
-					if (!parseNode(childNode)) {
-						return false;
-					}
+	m_data = source.m_data;
+	m_size = source.m_size;
+	m_root = source.m_root;
+	m_lastError = source.m_lastError;
+}
 
-					break;
+bool FileLoader::parseNodes()
+{
+	struct OpenNode {
+		uint32_t index;
+		uint32_t lastChild;
+	};
+
+	std::vector<OpenNode> openNodes;
+	bool readingProps = false;
+
+	// a rough guess that avoids most of the reallocations on large maps
+	m_nodes.clear();
+	m_nodes.reserve(m_size / 16);
+
+	size_t pos = 4;
+	while (pos < m_size) {
+		switch (m_data[pos]) {
+			case NODE_START: {
+				if (readingProps) {
+					NodeStruct& node = m_nodes[openNodes.back().index];
+					node.propsSize = pos - node.start;
 				}
 
-				case NODE_END: {
-					//current node end
-					if (!setPropsSize) {
-						if (!safeTell(pos)) {
-							return false;
-						}
+				if (pos + 1 >= m_size) {
+					m_lastError = ERROR_EOF;
+					return false;
+				}
 
-						currentNode->propsSize = pos - currentNode->start - 2;
+				uint32_t index = m_nodes.size();
+				if (!openNodes.empty()) {
+					OpenNode& parent = openNodes.back();
+					if (parent.lastChild != 0) {
+						m_nodes[parent.lastChild].next = index;
+					} else {
+						m_nodes[parent.index].hasChild = true;
 					}
+					parent.lastChild = index;
+				}
 
-					if (!readByte(byte)) {
-						return true;
-					}
+				m_nodes.emplace_back();
+				NodeStruct& node = m_nodes.back();
+				node.type = m_data[pos + 1];
+				node.start = pos + 2;
 
-					switch (byte) {
-						case NODE_START: {
-							//starts next node
-							if (!safeTell(pos)) {
-								return false;
-							}
-
-							skipNode = true;
-							NODE nextNode = new NodeStruct();
-							nextNode->start = pos;
-							currentNode->next = nextNode;
-							currentNode = nextNode;
-							break;
-						}
-
-						case NODE_END:
-							return safeTell(pos) && safeSeek(pos);
-
-						default:
-							m_lastError = ERROR_INVALID_FORMAT;
-							return false;
-					}
+				openNodes.push_back({index, 0});
+				readingProps = true;
+				pos += 2;
+				continue;
+			}
 
-					break;
+			case NODE_END: {
+				if (readingProps) {
+					NodeStruct& node = m_nodes[openNodes.back().index];
+					node.propsSize = pos - node.start;
+					readingProps = false;
 				}
 
-				case ESCAPE_CHAR: {
-					if (!readByte(byte)) {
-						return false;
-					}
-
-					break;
+				openNodes.pop_back();
+				if (openNodes.empty()) {
+					m_root = m_nodes.data();
+					return true;
 				}
-
-				default:
-					break;
+				break;
 			}
 
-			if (skipNode) {
+			case ESCAPE_CHAR: {
+				if (readingProps) {
+					m_nodes[openNodes.back().index].escaped = true;
+				}
+				++pos;
 				break;
 			}
+
+			default:
+				break;
 		}
+		++pos;
 	}
+
+	m_lastError = ERROR_EOF;
 	return false;
 }
 
@@ -198,38 +160,24 @@ const uint8_t* FileLoader::getProps(const NODE node, size_t& size)
 		return nullptr;
 	}
 
-	if (node->propsSize >= m_buffer_size) {
-		delete[] m_buffer;
-
-		while (node->propsSize >= m_buffer_size) {
-			m_buffer_size *= 2;
-		}
-
-		m_buffer = new uint8_t[m_buffer_size];
+	const uint8_t* props = m_data + node->start;
+	if (!node->escaped) {
+		size = node->propsSize;
+		return props;
 	}
 
-	//get buffer
-	if (!readBytes(m_buffer, node->propsSize, node->start + 2)) {
-		return nullptr;
-	}
+	m_buffer.resize(node->propsSize);
 
-	//unscape buffer
 	size_t j = 0;
-	bool escaped = false;
 	for (uint32_t i = 0; i < node->propsSize; ++i, ++j) {
-		if (m_buffer[i] == ESCAPE_CHAR) {
-			//escape char found, skip it and write next
-			m_buffer[j] = m_buffer[++i];
-			//is neede a displacement for next bytes
-			escaped = true;
-		} else if (escaped) {
-			//perform that displacement
-			m_buffer[j] = m_buffer[i];
+		if (props[i] == ESCAPE_CHAR) {
+			++i;
 		}
+		m_buffer[j] = props[i];
 	}
 
 	size = j;
-	return m_buffer;
+	return m_buffer.data();
 }
 
 bool FileLoader::getProps(const NODE node, PropStream& props)
@@ -246,173 +194,29 @@ bool FileLoader::getProps(const NODE node, PropStream& props)
 
 NODE FileLoader::getChildNode(const NODE parent, uint32_t& type)
 {
+	NODE child;
 	if (parent) {
-		NODE child = parent->child;
-		if (child) {
-			type = child->type;
+		if (!parent->hasChild) {
+			return NO_NODE;
 		}
-
-		return child;
+		child = parent + 1;
+	} else if (m_root) {
+		child = m_root;
+	} else {
+		return NO_NODE;
 	}
 
-	type = m_root->type;
-	return m_root;
+	type = child->type;
+	return child;
 }
 
 NODE FileLoader::getNextNode(const NODE prev, uint32_t& type)
 {
-	if (!prev) {
+	if (!prev || prev->next == 0) {
 		return NO_NODE;
 	}
 
-	NODE next = prev->next;
-	if (next) {
-		type = next->type;
-	}
+	NODE next = m_root + prev->next;
+	type = next->type;
 	return next;
 }
-
-inline bool FileLoader::readByte(int32_t& value)
-{
-	if (m_cache_index == NO_VALID_CACHE) {
-		m_lastError = ERROR_CACHE_ERROR;
-		return false;
-	}
-
-	if (m_cache_offset >= m_cached_data[m_cache_index].size) {
-		int32_t pos = m_cache_offset + m_cached_data[m_cache_index].base;
-		int32_t tmp = getCacheBlock(pos);
-		if (tmp < 0) {
-			return false;
-		}
-
-		m_cache_index = tmp;
-		m_cache_offset = pos - m_cached_data[m_cache_index].base;
-		if (m_cache_offset >= m_cached_data[m_cache_index].size) {
-			return false;
-		}
-	}
-
-	value = m_cached_data[m_cache_index].data[m_cache_offset++];
-	return true;
-}
-
-inline bool FileLoader::readBytes(uint8_t* buffer, uint32_t size, int32_t pos)
-{
-	//seek at pos
-	uint32_t remain = size, bufferPos = 0;
-	do {
-		//prepare cache
-		uint32_t i = getCacheBlock(pos);
-		if (i == NO_VALID_CACHE) {
-			return false;
-		}
-
-		m_cache_index = i;
-		m_cache_offset = pos - m_cached_data[i].base;
-
-		//get maximum read block size and calculate remaining bytes
-		uint32_t reading = std::min<int32_t>(remain, m_cached_data[i].size - m_cache_offset);
-		remain -= reading;
-
-		//read it
-		memcpy(buffer + bufferPos, m_cached_data[m_cache_index].data + m_cache_offset, reading);
-
-		//update variables
-		m_cache_offset += reading;
-		bufferPos += reading;
-		pos += reading;
-	} while (remain > 0);
-	return true;
-}
-
-inline bool FileLoader::safeSeek(uint32_t pos)
-{
-	uint32_t i = getCacheBlock(pos);
-	if (i == NO_VALID_CACHE) {
-		return false;
-	}
-
-	m_cache_index = i;
-	m_cache_offset = pos - m_cached_data[i].base;
-	return true;
-}
-
-inline bool FileLoader::safeTell(int32_t& pos)
-{
-	if (m_cache_index == NO_VALID_CACHE) {
-		m_lastError = ERROR_CACHE_ERROR;
-		return false;
-	}
-
-	pos = m_cached_data[m_cache_index].base + m_cache_offset - 1;
-	return true;
-}
-
-inline uint32_t FileLoader::getCacheBlock(uint32_t pos)
-{
-	bool found = false;
-	uint32_t i, base_pos = pos & ~(m_cache_size - 1);
-
-	for (i = 0; i < CACHE_BLOCKS; i++) {
-		if (m_cached_data[i].loaded) {
-			if (m_cached_data[i].base == base_pos) {
-				found = true;
-				break;
-			}
-		}
-	}
-
-	if (!found) {
-		i = loadCacheBlock(pos);
-	}
-
-	return i;
-}
-
-int32_t FileLoader::loadCacheBlock(uint32_t pos)
-{
-	int32_t i, loading_cache = -1, base_pos = pos & ~(m_cache_size - 1);
-
-	for (i = 0; i < CACHE_BLOCKS; i++) {
-		if (!m_cached_data[i].loaded) {
-			loading_cache = i;
-			break;
-		}
-	}
-
-	if (loading_cache == -1) {
-		for (i = 0; i < CACHE_BLOCKS; i++) {
-			if (std::abs(static_cast<long>(m_cached_data[i].base) - base_pos) > static_cast<long>(2 * m_cache_size)) {
-				loading_cache = i;
-				break;
-			}
-		}
-
-		if (loading_cache == -1) {
-			loading_cache = 0;
-		}
-	}
-
-	if (m_cached_data[loading_cache].data == nullptr) {
-		m_cached_data[loading_cache].data = new uint8_t[m_cache_size];
-	}
-
-	m_cached_data[loading_cache].base = base_pos;
-
-	if (fseek(m_file, m_cached_data[loading_cache].base, SEEK_SET) != 0) {
-		m_lastError = ERROR_SEEK_ERROR;
-		return -1;
-	}
-
-	uint32_t size = fread(m_cached_data[loading_cache].data, 1, m_cache_size, m_file);
-	m_cached_data[loading_cache].size = size;
-
-	if (size < (pos - m_cached_data[loading_cache].base)) {
-		m_lastError = ERROR_SEEK_ERROR;
-		return -1;
-	}
-
-	m_cached_data[loading_cache].loaded = 1;
-	return loading_cache;
-}
@@ -20,54 +20,25 @@
 #ifndef FS_FILELOADER_H_9B663D19E58D42E6BFACFE5B09D7A05E
 #define FS_FILELOADER_H_9B663D19E58D42E6BFACFE5B09D7A05E
 
-struct NodeStruct;
-
-typedef NodeStruct* NODE;
-
+namespace boost {
+namespace iostreams {
+class mapped_file_source;
+}
+}
+
+// One entry of the flat node index. Entries are stored in file order, so the
+// first child of a node, if it has any, is always the entry right after it.
 struct NodeStruct {
-	NodeStruct() : start(0), propsSize(0), type(0), next(nullptr), child(nullptr) {}
-
-	uint32_t start;
-	uint32_t propsSize;
-	uint32_t type;
-	NodeStruct* next;
-	NodeStruct* child;
-
-	static void clearNet(NodeStruct* root) {
-		if (root) {
-			clearChild(root);
-		}
-	}
-
-	private:
-		static void clearNext(NodeStruct* node) {
-			NodeStruct* deleteNode = node;
-			NodeStruct* nextNode;
-
-			while (deleteNode) {
-				if (deleteNode->child) {
-					clearChild(deleteNode->child);
-				}
-
-				nextNode = deleteNode->next;
-				delete deleteNode;
-				deleteNode = nextNode;
-			}
-		}
-
-		static void clearChild(NodeStruct* node) {
-			if (node->child) {
-				clearChild(node->child);
-			}
-
-			if (node->next) {
-				clearNext(node->next);
-			}
-
-			delete node;
-		}
+	uint32_t start = 0;
+	uint32_t propsSize = 0;
+	uint32_t next = 0;
+	uint8_t type = 0;
+	bool hasChild = false;
+	bool escaped = false;
 };
 
+typedef NodeStruct* NODE;
+
 #define NO_NODE 0
 
 enum FILELOADER_ERRORS {
@@ -87,6 +58,9 @@ enum FILELOADER_ERRORS {
 
 class PropStream;
 
+// Maps the whole file into memory and indexes every node in a single pass.
+// Properties are handed out straight from the mapping, only nodes that
+// contain escaped bytes are copied into the unescape buffer.
 class FileLoader
 {
 	public:
@@ -98,6 +72,11 @@ class FileLoader
 		FileLoader& operator=(const FileLoader&) = delete;
 
 		bool openFile(const char* filename, const char* identifier);
+
+		// reads the file opened by source through a separate unescape buffer, so
+		// several threads can decode nodes at once; source must outlive it
+		void openFile(const FileLoader& source);
+
 		const uint8_t* getProps(const NODE, size_t& size);
 		bool getProps(const NODE, PropStream& props);
 		NODE getChildNode(const NODE parent, uint32_t& type);
@@ -114,38 +93,17 @@ class FileLoader
 			NODE_END = 0xFF,
 		};
 
-		bool parseNode(NODE node);
+		bool parseNodes();
 
-		inline bool readByte(int32_t& value);
-		inline bool readBytes(uint8_t* buffer, uint32_t size, int32_t pos);
-		inline bool safeSeek(uint32_t pos);
-		inline bool safeTell(int32_t& pos);
+		std::unique_ptr<boost::iostreams::mapped_file_source> m_file;
+		const uint8_t* m_data;
+		size_t m_size;
 
-	protected:
-		struct _cache {
-			uint8_t* data;
-			uint32_t loaded;
-			uint32_t base;
-			uint32_t size;
-		};
-
-#define CACHE_BLOCKS 3
-		_cache m_cached_data[CACHE_BLOCKS];
-
-		uint8_t* m_buffer;
-		NODE m_root;
-		FILE* m_file;
+		std::vector<NodeStruct> m_nodes;
+		NodeStruct* m_root;
+		std::vector<uint8_t> m_buffer;
 
 		FILELOADER_ERRORS m_lastError;
-		uint32_t m_buffer_size;
-
-		uint32_t m_cache_size;
-#define NO_VALID_CACHE 0xFFFFFFFF
-		uint32_t m_cache_index;
-		uint32_t m_cache_offset;
-
-		inline uint32_t getCacheBlock(uint32_t pos);
-		int32_t loadCacheBlock(uint32_t pos);
 };
 
 class PropStream
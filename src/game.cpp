@@ -49,6 +49,7 @@
 #include "connection.h"
 #include "events.h"
 #include "databasetasks.h"
+#include "pathfinder.h"
 
 extern ConfigManager g_config;
 extern Actions* g_actions;
@@ -94,8 +95,8 @@ void Game::start(ServiceManager* manager)
 	serviceManager = manager;
 
 	g_scheduler.addEvent(createSchedulerTask(EVENT_LIGHTINTERVAL, std::bind(&Game::checkLight, this)));
-	g_scheduler.addEvent(createSchedulerTask(EVENT_CREATURE_THINK_INTERVAL, std::bind(&Game::checkCreatures, this, 0)));
-	g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this)));
+	g_scheduler.addEvent(createSchedulerTask(EVENT_CREATURE_THINK_INTERVAL, std::bind(&Game::checkCreatures, this, 0), TASK_ORIGIN_CHECK_CREATURES));
+	g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this), TASK_ORIGIN_CHECK_DECAY));
 }
 
 GameState_t Game::getGameState() const
@@ -3272,26 +3273,24 @@ bool Game::internalCreatureSay(Creature* creature, SpeakClasses type, const std:
 		pos = &creature->getPosition();
 	}
 
-	SpectatorVec list;
+	// use the spectators of the caller if it has them already, else look them
+	// up into a borrowed buffer
+	SpectatorBuffer buffer;
+	const SpectatorVec* list = listPtr;
 
 	if (!listPtr || listPtr->empty()) {
-		// This somewhat complex construct ensures that the cached SpectatorVec
-		// is used if available and if it can be used, else a local vector is
-		// used (hopefully the compiler will optimize away the construction of
-		// the temporary when it's not used).
 		if (type != TALKTYPE_YELL && type != TALKTYPE_MONSTER_YELL) {
-			map.getSpectators(list, *pos, false, false,
+			map.getSpectators(*buffer, *pos, false, false,
 			              Map::maxClientViewportX, Map::maxClientViewportX,
 			              Map::maxClientViewportY, Map::maxClientViewportY);
 		} else {
-			map.getSpectators(list, *pos, true, false, 18, 18, 14, 14);
+			map.getSpectators(*buffer, *pos, true, false, 18, 18, 14, 14);
 		}
-	} else {
-		list = (*listPtr);
+		list = &*buffer;
 	}
 
 	//send to client
-	for (Creature* spectator : list) {
+	for (Creature* spectator : *list) {
 		if (Player* tmpPlayer = spectator->getPlayer()) {
 			if (!ghostMode || tmpPlayer->canSeeCreature(creature)) {
 				tmpPlayer->sendCreatureSay(creature, type, text, pos);
@@ -3300,7 +3299,7 @@ bool Game::internalCreatureSay(Creature* creature, SpeakClasses type, const std:
 	}
 
 	//event method
-	for (Creature* spectator : list) {
+	for (Creature* spectator : *list) {
 		spectator->onCreatureSay(creature, type, text);
 	}
 	return true;
@@ -3354,7 +3353,7 @@ void Game::removeCreatureCheck(Creature* creature)
 
 void Game::checkCreatures(size_t index)
 {
-	g_scheduler.addEvent(createSchedulerTask(EVENT_CHECK_CREATURE_INTERVAL, std::bind(&Game::checkCreatures, this, (index + 1) % EVENT_CREATURECOUNT)));
+	g_scheduler.addEvent(createSchedulerTask(EVENT_CHECK_CREATURE_INTERVAL, std::bind(&Game::checkCreatures, this, (index + 1) % EVENT_CREATURECOUNT), TASK_ORIGIN_CHECK_CREATURES));
 
 	auto& checkCreatureList = checkCreatureLists[index];
 	auto it = checkCreatureList.begin(), end = checkCreatureList.end();
@@ -3387,9 +3386,9 @@ void Game::changeSpeed(Creature* creature, int32_t varSpeedDelta)
 	creature->setSpeed(varSpeed);
 
 	//send to clients
-	SpectatorVec list;
-	map.getSpectators(list, creature->getPosition(), false, true);
-	for (Creature* spectator : list) {
+	SpectatorBuffer list;
+	map.getSpectators(*list, creature->getPosition(), false, true);
+	for (Creature* spectator : *list) {
 		spectator->getPlayer()->sendChangeSpeed(creature, creature->getStepSpeed());
 	}
 }
@@ -3995,9 +3994,9 @@ bool Game::combatChangeMana(Creature* attacker, Creature* target, int32_t manaCh
 
 void Game::addCreatureHealth(const Creature* target)
 {
-	SpectatorVec list;
-	map.getSpectators(list, target->getPosition(), true, true);
-	addCreatureHealth(list, target);
+	SpectatorBuffer list;
+	map.getSpectators(*list, target->getPosition(), true, true);
+	addCreatureHealth(*list, target);
 }
 
 void Game::addCreatureHealth(const SpectatorVec& list, const Creature* target)
@@ -4011,9 +4010,9 @@ void Game::addCreatureHealth(const SpectatorVec& list, const Creature* target)
 
 void Game::addMagicEffect(const Position& pos, uint8_t effect)
 {
-	SpectatorVec list;
-	map.getSpectators(list, pos, true, true);
-	addMagicEffect(list, pos, effect);
+	SpectatorBuffer list;
+	map.getSpectators(*list, pos, true, true);
+	addMagicEffect(*list, pos, effect);
 }
 
 void Game::addMagicEffect(const SpectatorVec& list, const Position& pos, uint8_t effect)
@@ -4027,10 +4026,10 @@ void Game::addMagicEffect(const SpectatorVec& list, const Position& pos, uint8_t
 
 void Game::addDistanceEffect(const Position& fromPos, const Position& toPos, uint8_t effect)
 {
-	SpectatorVec list;
-	map.getSpectators(list, fromPos, false, true);
-	map.getSpectators(list, toPos, false, true);
-	addDistanceEffect(list, fromPos, toPos, effect);
+	SpectatorBuffer list;
+	map.getSpectators(*list, fromPos, false, true);
+	map.getSpectators(*list, toPos, false, true);
+	addDistanceEffect(*list, fromPos, toPos, effect);
 }
 
 void Game::addDistanceEffect(const SpectatorVec& list, const Position& fromPos, const Position& toPos, uint8_t effect)
@@ -4078,7 +4077,7 @@ void Game::internalDecayItem(Item* item)
 
 void Game::checkDecay()
 {
-	g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this)));
+	g_scheduler.addEvent(createSchedulerTask(EVENT_DECAYINTERVAL, std::bind(&Game::checkDecay, this), TASK_ORIGIN_CHECK_DECAY));
 
 	size_t bucket = (lastBucket + 1) % EVENT_DECAY_BUCKETS;
 
@@ -4203,6 +4202,7 @@ void Game::shutdown()
 
 	g_scheduler.shutdown();
 	g_databaseTasks.shutdown();
+	g_pathfinder.shutdown();
 	g_dispatcher.shutdown();
 	map.spawns.clear();
 	raids.clear();
@@ -188,6 +188,8 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 		}
 	}
 
+	std::vector<NODE> areaNodes;
+
 	NODE nodeMapData = f.getChildNode(nodeMap, type);
 	while (nodeMapData != NO_NODE) {
 		if (f.getError() != ERROR_NONE) {
@@ -196,291 +198,465 @@ bool IOMap::loadMap(Map* map, const std::string& identifier)
 		}
 
 		if (type == OTBM_TILE_AREA) {
-			if (!f.getProps(nodeMapData, propStream)) {
-				setLastErrorString("Invalid map node.");
+			areaNodes.push_back(nodeMapData);
+		} else if (type == OTBM_TOWNS) {
+			if (!parseTowns(f, nodeMapData, *map)) {
 				return false;
 			}
-
-			const OTBM_Destination_coords* area_coord;
-			if (!propStream.readStruct(area_coord)) {
-				setLastErrorString("Invalid map node.");
+		} else if (type == OTBM_WAYPOINTS && headerVersion > 1) {
+			if (!parseWaypoints(f, nodeMapData, *map)) {
 				return false;
 			}
+		} else {
+			setLastErrorString("Unknown map node.");
+			return false;
+		}
 
-			int32_t base_x = area_coord->x;
-			int32_t base_y = area_coord->y;
-			int32_t base_z = area_coord->z;
+		nodeMapData = f.getNextNode(nodeMapData, type);
+	}
 
-			NODE nodeTile = f.getChildNode(nodeMapData, type);
-			while (nodeTile != NO_NODE) {
-				if (f.getError() != ERROR_NONE) {
-					setLastErrorString("Could not read node data.");
-					return false;
-				}
+	if (!loadTileAreas(f, areaNodes, *map)) {
+		return false;
+	}
 
-				if (type != OTBM_TILE && type != OTBM_HOUSETILE) {
-					setLastErrorString("Unknown tile node.");
-					return false;
-				}
+	std::cout << "> Map loading time: " << (OTSYS_TIME() - start) / (1000.) << " seconds." << std::endl;
+	return true;
+}
 
-				if (!f.getProps(nodeTile, propStream)) {
-					setLastErrorString("Could not read node data.");
-					return false;
-				}
+struct StagedItem {
+	Item* item;
+	// beds are decoded on the dispatcher, they look up their sleeper
+	NODE node;
+};
+
+struct StagedTile {
+	std::vector<StagedItem> items;
+	uint32_t houseId;
+	uint32_t flags;
+	uint16_t x;
+	uint16_t y;
+	uint8_t z;
+	bool isHouseTile;
+};
+
+struct StagedTileArea {
+	StagedTileArea() = default;
+	~StagedTileArea() {
+		for (const StagedTile& tile : tiles) {
+			for (const StagedItem& staged : tile.items) {
+				delete staged.item;
+			}
+		}
+	}
 
-				const OTBM_Tile_coords* tile_coord;
-				if (!propStream.readStruct(tile_coord)) {
-					setLastErrorString("Could not read tile position.");
-					return false;
-				}
+	// non-copyable
+	StagedTileArea(const StagedTileArea&) = delete;
+	StagedTileArea& operator=(const StagedTileArea&) = delete;
 
-				uint16_t px = base_x + tile_coord->x;
-				uint16_t py = base_y + tile_coord->y;
-				uint16_t pz = base_z;
+	std::vector<StagedTile> tiles;
+	std::string error;
+	bool decoded = false;
+};
 
-				bool isHouseTile = false;
-				House* house = nullptr;
-				Tile* tile = nullptr;
-				Item* ground_item = nullptr;
-				uint32_t tileflags = TILESTATE_NONE;
+static void registerUniqueIds(Item* item)
+{
+	item->registerUniqueId();
+	if (Container* container = item->getContainer()) {
+		for (Item* containerItem : container->getItemList()) {
+			registerUniqueIds(containerItem);
+		}
+	}
+}
 
-				if (type == OTBM_HOUSETILE) {
-					uint32_t houseId;
-					if (!propStream.read<uint32_t>(houseId)) {
-						std::ostringstream ss;
-						ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Could not read house id.";
-						setLastErrorString(ss.str());
-						return false;
-					}
+// Runs on the loader threads, so it only creates items and touches nothing
+// shared; houses, tiles and unique ids are left to commitTileArea.
+static bool decodeTileArea(FileLoader& f, NODE areaNode, StagedTileArea& area)
+{
+	PropStream propStream;
+	uint32_t type;
+	uint8_t attribute;
 
-					house = map->houses.addHouse(houseId);
-					if (!house) {
-						std::ostringstream ss;
-						ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Could not create house id: " << houseId;
-						setLastErrorString(ss.str());
-						return false;
-					}
+	if (!f.getProps(areaNode, propStream)) {
+		area.error = "Invalid map node.";
+		return false;
+	}
 
-					tile = new HouseTile(px, py, pz, house);
-					house->addTile(reinterpret_cast<HouseTile*>(tile));
-					isHouseTile = true;
-				}
+	const OTBM_Destination_coords* area_coord;
+	if (!propStream.readStruct(area_coord)) {
+		area.error = "Invalid map node.";
+		return false;
+	}
 
-				//read tile attributes
-				while (propStream.read<uint8_t>(attribute)) {
-					switch (attribute) {
-						case OTBM_ATTR_TILE_FLAGS: {
-							uint32_t flags;
-							if (!propStream.read<uint32_t>(flags)) {
-								std::ostringstream ss;
-								ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Failed to read tile flags.";
-								setLastErrorString(ss.str());
-								return false;
-							}
-
-							if ((flags & TILESTATE_PROTECTIONZONE) == TILESTATE_PROTECTIONZONE) {
-								tileflags |= TILESTATE_PROTECTIONZONE;
-							} else if ((flags & TILESTATE_NOPVPZONE) == TILESTATE_NOPVPZONE) {
-								tileflags |= TILESTATE_NOPVPZONE;
-							} else if ((flags & TILESTATE_PVPZONE) == TILESTATE_PVPZONE) {
-								tileflags |= TILESTATE_PVPZONE;
-							}
-
-							if ((flags & TILESTATE_NOLOGOUT) == TILESTATE_NOLOGOUT) {
-								tileflags |= TILESTATE_NOLOGOUT;
-							}
-							break;
-						}
-
-						case OTBM_ATTR_ITEM: {
-							Item* item = Item::CreateItem(propStream);
-							if (!item) {
-								std::ostringstream ss;
-								ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Failed to create item.";
-								setLastErrorString(ss.str());
-								return false;
-							}
-
-							if (isHouseTile && item->isMoveable()) {
-								std::cout << "[Warning - IOMap::loadMap] Moveable item with ID: " << item->getID() << ", in house: " << house->getId() << ", at position [x: " << px << ", y: " << py << ", z: " << pz << "]." << std::endl;
-								delete item;
-							} else {
-								if (item->getItemCount() <= 0) {
-									item->setItemCount(1);
-								}
-
-								if (tile) {
-									tile->internalAddThing(item);
-									item->startDecaying();
-									item->setLoadedFromMap(true);
-								} else if (item->isGroundTile()) {
-									delete ground_item;
-									ground_item = item;
-								} else {
-									tile = createTile(ground_item, item, px, py, pz);
-									tile->internalAddThing(item);
-									item->startDecaying();
-									item->setLoadedFromMap(true);
-								}
-							}
-							break;
-						}
-
-						default:
-							std::ostringstream ss;
-							ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Unknown tile attribute.";
-							setLastErrorString(ss.str());
-							return false;
-					}
-				}
+	int32_t base_x = area_coord->x;
+	int32_t base_y = area_coord->y;
+	int32_t base_z = area_coord->z;
+
+	NODE nodeTile = f.getChildNode(areaNode, type);
+	while (nodeTile != NO_NODE) {
+		if (type != OTBM_TILE && type != OTBM_HOUSETILE) {
+			area.error = "Unknown tile node.";
+			return false;
+		}
+
+		if (!f.getProps(nodeTile, propStream)) {
+			area.error = "Could not read node data.";
+			return false;
+		}
+
+		const OTBM_Tile_coords* tile_coord;
+		if (!propStream.readStruct(tile_coord)) {
+			area.error = "Could not read tile position.";
+			return false;
+		}
 
-				NODE nodeItem = f.getChildNode(nodeTile, type);
-				while (nodeItem) {
-					if (type != OTBM_ITEM) {
+		area.tiles.emplace_back();
+		StagedTile& tile = area.tiles.back();
+		tile.x = base_x + tile_coord->x;
+		tile.y = base_y + tile_coord->y;
+		tile.z = base_z;
+		tile.houseId = 0;
+		tile.flags = TILESTATE_NONE;
+		tile.isHouseTile = type == OTBM_HOUSETILE;
+
+		if (tile.isHouseTile && !propStream.read<uint32_t>(tile.houseId)) {
+			std::ostringstream ss;
+			ss << "[x:" << tile.x << ", y:" << tile.y << ", z:" << static_cast<uint16_t>(tile.z) << "] Could not read house id.";
+			area.error = ss.str();
+			return false;
+		}
+
+		//read tile attributes
+		while (propStream.read<uint8_t>(attribute)) {
+			switch (attribute) {
+				case OTBM_ATTR_TILE_FLAGS: {
+					uint32_t flags;
+					if (!propStream.read<uint32_t>(flags)) {
 						std::ostringstream ss;
-						ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Unknown node type.";
-						setLastErrorString(ss.str());
+						ss << "[x:" << tile.x << ", y:" << tile.y << ", z:" << static_cast<uint16_t>(tile.z) << "] Failed to read tile flags.";
+						area.error = ss.str();
 						return false;
 					}
 
-					PropStream stream;
-					if (!f.getProps(nodeItem, stream)) {
-						setLastErrorString("Invalid item node.");
-						return false;
+					if ((flags & TILESTATE_PROTECTIONZONE) == TILESTATE_PROTECTIONZONE) {
+						tile.flags |= TILESTATE_PROTECTIONZONE;
+					} else if ((flags & TILESTATE_NOPVPZONE) == TILESTATE_NOPVPZONE) {
+						tile.flags |= TILESTATE_NOPVPZONE;
+					} else if ((flags & TILESTATE_PVPZONE) == TILESTATE_PVPZONE) {
+						tile.flags |= TILESTATE_PVPZONE;
 					}
 
-					Item* item = Item::CreateItem(stream);
-					if (!item) {
-						std::ostringstream ss;
-						ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Failed to create item.";
-						setLastErrorString(ss.str());
-						return false;
+					if ((flags & TILESTATE_NOLOGOUT) == TILESTATE_NOLOGOUT) {
+						tile.flags |= TILESTATE_NOLOGOUT;
 					}
+					break;
+				}
 
-					if (!item->unserializeItemNode(f, nodeItem, stream)) {
+				case OTBM_ATTR_ITEM: {
+					Item* item = Item::CreateItem(propStream);
+					if (!item) {
 						std::ostringstream ss;
-						ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Failed to load item " << item->getID() << '.';
-						setLastErrorString(ss.str());
-						delete item;
+						ss << "[x:" << tile.x << ", y:" << tile.y << ", z:" << static_cast<uint16_t>(tile.z) << "] Failed to create item.";
+						area.error = ss.str();
 						return false;
 					}
 
-					if (isHouseTile && item->isMoveable()) {
-						std::cout << "[Warning - IOMap::loadMap] Moveable item with ID: " << item->getID() << ", in house: " << house->getId() << ", at position [x: " << px << ", y: " << py << ", z: " << pz << "]." << std::endl;
-						delete item;
-					} else {
-						if (item->getItemCount() <= 0) {
-							item->setItemCount(1);
-						}
-
-						if (tile) {
-							tile->internalAddThing(item);
-							item->startDecaying();
-							item->setLoadedFromMap(true);
-						} else if (item->isGroundTile()) {
-							delete ground_item;
-							ground_item = item;
-						} else {
-							tile = createTile(ground_item, item, px, py, pz);
-							tile->internalAddThing(item);
-							item->startDecaying();
-							item->setLoadedFromMap(true);
-						}
-					}
-
-					nodeItem = f.getNextNode(nodeItem, type);
+					tile.items.push_back({item, nullptr});
+					break;
 				}
 
-				if (!tile) {
-					tile = createTile(ground_item, nullptr, px, py, pz);
-				}
+				default:
+					std::ostringstream ss;
+					ss << "[x:" << tile.x << ", y:" << tile.y << ", z:" << static_cast<uint16_t>(tile.z) << "] Unknown tile attribute.";
+					area.error = ss.str();
+					return false;
+			}
+		}
 
-				tile->setFlag(static_cast<tileflags_t>(tileflags));
+		NODE nodeItem = f.getChildNode(nodeTile, type);
+		while (nodeItem) {
+			if (type != OTBM_ITEM) {
+				std::ostringstream ss;
+				ss << "[x:" << tile.x << ", y:" << tile.y << ", z:" << static_cast<uint16_t>(tile.z) << "] Unknown node type.";
+				area.error = ss.str();
+				return false;
+			}
 
-				map->setTile(px, py, pz, tile);
+			PropStream stream;
+			if (!f.getProps(nodeItem, stream)) {
+				area.error = "Invalid item node.";
+				return false;
+			}
 
-				nodeTile = f.getNextNode(nodeTile, type);
+			Item* item = Item::CreateItem(stream);
+			if (!item) {
+				std::ostringstream ss;
+				ss << "[x:" << tile.x << ", y:" << tile.y << ", z:" << static_cast<uint16_t>(tile.z) << "] Failed to create item.";
+				area.error = ss.str();
+				return false;
 			}
-		} else if (type == OTBM_TOWNS) {
-			NODE nodeTown = f.getChildNode(nodeMapData, type);
-			while (nodeTown != NO_NODE) {
-				if (type != OTBM_TOWN) {
-					setLastErrorString("Unknown town node.");
-					return false;
-				}
 
-				if (!f.getProps(nodeTown, propStream)) {
-					setLastErrorString("Could not read town data.");
-					return false;
-				}
+			if (item->getBed()) {
+				delete item;
+				tile.items.push_back({nullptr, nodeItem});
+			} else if (!item->unserializeItemNode(f, nodeItem, stream)) {
+				std::ostringstream ss;
+				ss << "[x:" << tile.x << ", y:" << tile.y << ", z:" << static_cast<uint16_t>(tile.z) << "] Failed to load item " << item->getID() << '.';
+				area.error = ss.str();
+				delete item;
+				return false;
+			} else {
+				tile.items.push_back({item, nullptr});
+			}
 
-				uint32_t townId;
-				if (!propStream.read<uint32_t>(townId)) {
-					setLastErrorString("Could not read town id.");
-					return false;
-				}
+			nodeItem = f.getNextNode(nodeItem, type);
+		}
 
-				Town* town = map->towns.getTown(townId);
-				if (!town) {
-					town = new Town(townId);
-					map->towns.addTown(townId, town);
-				}
+		nodeTile = f.getNextNode(nodeTile, type);
+	}
+	return true;
+}
 
-				std::string townName;
-				if (!propStream.readString(townName)) {
-					setLastErrorString("Could not read town name.");
-					return false;
-				}
+bool IOMap::commitTileArea(FileLoader& f, StagedTileArea& area, Map& map)
+{
+	if (!area.error.empty()) {
+		setLastErrorString(area.error);
+		return false;
+	}
 
-				town->setName(townName);
+	for (StagedTile& stagedTile : area.tiles) {
+		uint16_t px = stagedTile.x;
+		uint16_t py = stagedTile.y;
+		uint16_t pz = stagedTile.z;
+
+		House* house = nullptr;
+		Tile* tile = nullptr;
+		Item* ground_item = nullptr;
+
+		if (stagedTile.isHouseTile) {
+			house = map.houses.addHouse(stagedTile.houseId);
+			if (!house) {
+				std::ostringstream ss;
+				ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Could not create house id: " << stagedTile.houseId;
+				setLastErrorString(ss.str());
+				return false;
+			}
 
-				const OTBM_Destination_coords* town_coords;
-				if (!propStream.readStruct(town_coords)) {
-					setLastErrorString("Could not read town coordinates.");
-					return false;
-				}
+			tile = new HouseTile(px, py, pz, house);
+			house->addTile(reinterpret_cast<HouseTile*>(tile));
+		}
 
-				town->setTemplePos(Position(town_coords->x, town_coords->y, town_coords->z));
+		for (StagedItem& staged : stagedTile.items) {
+			Item* item = staged.item;
+			staged.item = nullptr;
 
-				nodeTown = f.getNextNode(nodeTown, type);
-			}
-		} else if (type == OTBM_WAYPOINTS && headerVersion > 1) {
-			NODE nodeWaypoint = f.getChildNode(nodeMapData, type);
-			while (nodeWaypoint != NO_NODE) {
-				if (type != OTBM_WAYPOINT) {
-					setLastErrorString("Unknown waypoint node.");
-					return false;
+			if (item) {
+				if (stagedTile.isHouseTile && item->isMoveable()) {
+					std::cout << "[Warning - IOMap::loadMap] Moveable item with ID: " << item->getID() << ", in house: " << house->getId() << ", at position [x: " << px << ", y: " << py << ", z: " << pz << "]." << std::endl;
+					delete item;
+					continue;
 				}
 
-				if (!f.getProps(nodeWaypoint, propStream)) {
-					setLastErrorString("Could not read waypoint data.");
+				registerUniqueIds(item);
+			} else {
+				PropStream stream;
+				if (!f.getProps(staged.node, stream)) {
+					setLastErrorString("Invalid item node.");
 					return false;
 				}
 
-				std::string name;
-				if (!propStream.readString(name)) {
-					setLastErrorString("Could not read waypoint name.");
+				item = Item::CreateItem(stream);
+				if (!item) {
+					std::ostringstream ss;
+					ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Failed to create item.";
+					setLastErrorString(ss.str());
 					return false;
 				}
 
-				const OTBM_Destination_coords* waypoint_coords;
-				if (!propStream.readStruct(waypoint_coords)) {
-					setLastErrorString("Could not read waypoint coordinates.");
+				if (!item->unserializeItemNode(f, staged.node, stream)) {
+					std::ostringstream ss;
+					ss << "[x:" << px << ", y:" << py << ", z:" << pz << "] Failed to load item " << item->getID() << '.';
+					setLastErrorString(ss.str());
+					delete item;
 					return false;
 				}
 
-				map->waypoints[name] = Position(waypoint_coords->x, waypoint_coords->y, waypoint_coords->z);
+				if (stagedTile.isHouseTile && item->isMoveable()) {
+					std::cout << "[Warning - IOMap::loadMap] Moveable item with ID: " << item->getID() << ", in house: " << house->getId() << ", at position [x: " << px << ", y: " << py << ", z: " << pz << "]." << std::endl;
+					delete item;
+					continue;
+				}
+			}
 
-				nodeWaypoint = f.getNextNode(nodeWaypoint, type);
+			if (item->getItemCount() <= 0) {
+				item->setItemCount(1);
 			}
-		} else {
-			setLastErrorString("Unknown map node.");
+
+			if (tile) {
+				tile->internalAddThing(item);
+				item->startDecaying();
+				item->setLoadedFromMap(true);
+			} else if (item->isGroundTile()) {
+				delete ground_item;
+				ground_item = item;
+			} else {
+				tile = createTile(ground_item, item, px, py, pz);
+				tile->internalAddThing(item);
+				item->startDecaying();
+				item->setLoadedFromMap(true);
+			}
+		}
+
+		if (!tile) {
+			tile = createTile(ground_item, nullptr, px, py, pz);
+		}
+
+		tile->setFlag(static_cast<tileflags_t>(stagedTile.flags));
+
+		map.setTile(px, py, pz, tile);
+	}
+
+	area.tiles.clear();
+	area.tiles.shrink_to_fit();
+	return true;
+}
+
+bool IOMap::loadTileAreas(FileLoader& f, const std::vector<NODE>& areaNodes, Map& map)
+{
+	std::vector<StagedTileArea> areas(areaNodes.size());
+	std::atomic<size_t> nextArea {0};
+	std::atomic<bool> aborted {false};
+	std::mutex decodedLock;
+	std::condition_variable decodedSignal;
+
+	auto decode = [&]() {
+		FileLoader reader;
+		reader.openFile(f);
+		Item::deferUniqueIds = true;
+
+		while (!aborted.load(std::memory_order_relaxed)) {
+			size_t index = nextArea++;
+			if (index >= areas.size()) {
+				break;
+			}
+
+			decodeTileArea(reader, areaNodes[index], areas[index]);
+
+			std::lock_guard<std::mutex> lockClass(decodedLock);
+			areas[index].decoded = true;
+			decodedSignal.notify_one();
+		}
+	};
+
+	// areas are decoded in any order but go into the map in file order
+	const size_t threadCount = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), areas.size()));
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; ++i) {
+		threads.emplace_back(decode);
+	}
+
+	bool success = true;
+	for (StagedTileArea& area : areas) {
+		{
+			std::unique_lock<std::mutex> lockClass(decodedLock);
+			decodedSignal.wait(lockClass, [&area]() { return area.decoded; });
+		}
+
+		if (!commitTileArea(f, area, map)) {
+			aborted = true;
+			success = false;
+			break;
+		}
+	}
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	return success;
+}
+
+bool IOMap::parseTowns(FileLoader& f, NODE townsNode, Map& map)
+{
+	PropStream propStream;
+	uint32_t type;
+
+	NODE nodeTown = f.getChildNode(townsNode, type);
+	while (nodeTown != NO_NODE) {
+		if (type != OTBM_TOWN) {
+			setLastErrorString("Unknown town node.");
 			return false;
 		}
 
-		nodeMapData = f.getNextNode(nodeMapData, type);
+		if (!f.getProps(nodeTown, propStream)) {
+			setLastErrorString("Could not read town data.");
+			return false;
+		}
+
+		uint32_t townId;
+		if (!propStream.read<uint32_t>(townId)) {
+			setLastErrorString("Could not read town id.");
+			return false;
+		}
+
+		Town* town = map.towns.getTown(townId);
+		if (!town) {
+			town = new Town(townId);
+			map.towns.addTown(townId, town);
+		}
+
+		std::string townName;
+		if (!propStream.readString(townName)) {
+			setLastErrorString("Could not read town name.");
+			return false;
+		}
+
+		town->setName(townName);
+
+		const OTBM_Destination_coords* town_coords;
+		if (!propStream.readStruct(town_coords)) {
+			setLastErrorString("Could not read town coordinates.");
+			return false;
+		}
+
+		town->setTemplePos(Position(town_coords->x, town_coords->y, town_coords->z));
+
+		nodeTown = f.getNextNode(nodeTown, type);
 	}
+	return true;
+}
 
-	std::cout << "> Map loading time: " << (OTSYS_TIME() - start) / (1000.) << " seconds." << std::endl;
+bool IOMap::parseWaypoints(FileLoader& f, NODE waypointsNode, Map& map)
+{
+	PropStream propStream;
+	uint32_t type;
+
+	NODE nodeWaypoint = f.getChildNode(waypointsNode, type);
+	while (nodeWaypoint != NO_NODE) {
+		if (type != OTBM_WAYPOINT) {
+			setLastErrorString("Unknown waypoint node.");
+			return false;
+		}
+
+		if (!f.getProps(nodeWaypoint, propStream)) {
+			setLastErrorString("Could not read waypoint data.");
+			return false;
+		}
+
+		std::string name;
+		if (!propStream.readString(name)) {
+			setLastErrorString("Could not read waypoint name.");
+			return false;
+		}
+
+		const OTBM_Destination_coords* waypoint_coords;
+		if (!propStream.readStruct(waypoint_coords)) {
+			setLastErrorString("Could not read waypoint coordinates.");
+			return false;
+		}
+
+		map.waypoints[name] = Position(waypoint_coords->x, waypoint_coords->y, waypoint_coords->z);
+
+		nodeWaypoint = f.getNextNode(nodeWaypoint, type);
+	}
 	return true;
 }
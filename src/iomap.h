@@ -101,10 +101,18 @@ struct OTBM_HouseTile_coords {
 
 #pragma pack()
 
+struct StagedTileArea;
+
 class IOMap
 {
-		static Tile* createTile(Item*& ground, Item* item, int px, int py, int pz);
+		bool loadTileAreas(FileLoader& f, const std::vector<NODE>& areaNodes, Map& map);
+		bool commitTileArea(FileLoader& f, StagedTileArea& area, Map& map);
+		bool parseTowns(FileLoader& f, NODE townsNode, Map& map);
+		bool parseWaypoints(FileLoader& f, NODE waypointsNode, Map& map);
+
 	public:
+		static Tile* createTile(Item*& ground, Item* item, int px, int py, int pz);
+
 		bool loadMap(Map* map, const std::string& identifier);
 
 		/* Load the spawns
@@ -35,6 +35,7 @@
 extern Game g_game;
 
 Items Item::items;
+thread_local bool Item::deferUniqueIds = false;
 
 Item* Item::CreateItem(const uint16_t _type, uint16_t _count /*= 0*/)
 {
@@ -1472,11 +1473,19 @@ void Item::setUniqueId(uint16_t n)
 		return;
 	}
 
-	if (g_game.addUniqueItem(n, this)) {
+	if (deferUniqueIds || g_game.addUniqueItem(n, this)) {
 		getAttributes()->setUniqueId(n);
 	}
 }
 
+void Item::registerUniqueId()
+{
+	uint16_t uniqueId = getUniqueId();
+	if (uniqueId != 0 && !g_game.addUniqueItem(uniqueId, this)) {
+		removeAttribute(ITEM_ATTRIBUTE_UNIQUEID);
+	}
+}
+
 bool Item::canDecay() const
 {
 	if (isRemoved()) {
@@ -307,6 +307,10 @@ class Item : virtual public Thing
 		static Item* CreateItem(PropStream& propStream);
 		static Items items;
 
+		// set on threads that decode items off the dispatcher, unique ids read
+		// there are only stored and have to be registered with registerUniqueId
+		static thread_local bool deferUniqueIds;
+
 		// Constructor for items
 		Item(const uint16_t _type, uint16_t _count = 0);
 		Item(const Item& i);
@@ -681,6 +685,7 @@ class Item : virtual public Thing
 		void setSubType(uint16_t n);
 
 		void setUniqueId(uint16_t n);
+		void registerUniqueId();
 
 		void setDefaultDuration() {
 			uint32_t duration = getDefaultDuration();
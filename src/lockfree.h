@@ -0,0 +1,207 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_LOCKFREE_H_8C707AEB7C7235A2FBC5D4EDDF03B008
+#define FS_LOCKFREE_H_8C707AEB7C7235A2FBC5D4EDDF03B008
+
+#include <atomic>
+
+#include <boost/lockfree/stack.hpp>
+
+#define LOCKFREE_CACHELINE_SIZE 64
+
+// Bounded multi-producer single-consumer ring buffer.
+// Every cell carries a sequence number that tells producers whether the slot
+// is free and the consumer whether it has been published, so neither side
+// needs a lock. T should be cheap to copy (pointers, ids).
+template <typename T, size_t CAPACITY>
+class LockfreeBoundedQueue
+{
+	static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+	public:
+		LockfreeBoundedQueue() {
+			for (size_t i = 0; i < CAPACITY; ++i) {
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+			enqueuePos.store(0, std::memory_order_relaxed);
+		}
+
+		// non-copyable
+		LockfreeBoundedQueue(const LockfreeBoundedQueue&) = delete;
+		LockfreeBoundedQueue& operator=(const LockfreeBoundedQueue&) = delete;
+
+		// may be called from any thread, returns false when the queue is full
+		bool push(const T& value) {
+			size_t pos = enqueuePos.load(std::memory_order_relaxed);
+			while (true) {
+				Cell& cell = cells[pos & (CAPACITY - 1)];
+				size_t seq = cell.sequence.load(std::memory_order_acquire);
+				intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+				if (diff == 0) {
+					if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						cell.data = value;
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				} else if (diff < 0) {
+					return false;
+				} else {
+					pos = enqueuePos.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// consumer thread only
+		bool pop(T& value) {
+			Cell& cell = cells[dequeuePos & (CAPACITY - 1)];
+			if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+				return false;
+			}
+
+			value = cell.data;
+			cell.sequence.store(dequeuePos + CAPACITY, std::memory_order_release);
+			++dequeuePos;
+			return true;
+		}
+
+		// consumer thread only
+		bool empty() const {
+			const Cell& cell = cells[dequeuePos & (CAPACITY - 1)];
+			return cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1;
+		}
+
+		// consumer thread only, approximate while producers are pushing
+		size_t size() const {
+			return enqueuePos.load(std::memory_order_relaxed) - dequeuePos;
+		}
+
+		static constexpr size_t capacity() {
+			return CAPACITY;
+		}
+
+	private:
+		struct Cell {
+			std::atomic<size_t> sequence;
+			T data;
+		};
+
+		Cell cells[CAPACITY];
+
+		// keep the producer and consumer cursors on separate cache lines
+		char padding1[LOCKFREE_CACHELINE_SIZE];
+		std::atomic<size_t> enqueuePos;
+		char padding2[LOCKFREE_CACHELINE_SIZE];
+		size_t dequeuePos = 0;
+};
+
+// Free list shared by every LockfreePoolingAllocator of the same T
+template <typename T, size_t CAPACITY>
+struct LockfreeFreeList
+{
+	using FreeList = boost::lockfree::stack<void*, boost::lockfree::capacity<CAPACITY>>;
+	static FreeList& get() {
+		static FreeList freeList;
+		return freeList;
+	}
+};
+
+// Recycles raw storage for T. Up to CAPACITY released blocks are kept for
+// reuse, anything above that goes back to the global heap.
+template <typename T, size_t CAPACITY>
+class LockfreePoolingAllocator
+{
+	public:
+		static void* allocate() {
+			void* p;
+			if (!LockfreeFreeList<T, CAPACITY>::get().pop(p)) {
+				p = ::operator new(sizeof(T));
+			}
+			return p;
+		}
+
+		static void deallocate(void* p) {
+			if (!LockfreeFreeList<T, CAPACITY>::get().bounded_push(p)) {
+				::operator delete(p);
+			}
+		}
+};
+
+// Recycles whole objects of T. Every thread keeps up to LOCAL_CAPACITY of
+// them for itself and only goes to the shared stack (up to CAPACITY objects)
+// when its own cache is empty or full, so objects that are taken and
+// returned on the same thread never cause contention.
+template <typename T, size_t LOCAL_CAPACITY, size_t CAPACITY>
+class LockfreeObjectPool
+{
+	public:
+		// returns nullptr when there is nothing to reuse
+		static T* acquire() {
+			LocalCache& cache = getLocalCache();
+			if (cache.size != 0) {
+				return cache.objects[--cache.size];
+			}
+
+			T* object;
+			if (!getSharedStack().pop(object)) {
+				return nullptr;
+			}
+			return object;
+		}
+
+		// may be called from any thread, deletes the object when the pool is full
+		static void release(T* object) {
+			LocalCache& cache = getLocalCache();
+			if (cache.size < LOCAL_CAPACITY) {
+				cache.objects[cache.size++] = object;
+			} else if (!getSharedStack().bounded_push(object)) {
+				delete object;
+			}
+		}
+
+	private:
+		using SharedStack = boost::lockfree::stack<T*, boost::lockfree::capacity<CAPACITY>>;
+
+		struct LocalCache {
+			~LocalCache() {
+				// hand the objects of an exiting thread over to the others
+				while (size != 0) {
+					T* object = objects[--size];
+					if (!getSharedStack().bounded_push(object)) {
+						delete object;
+					}
+				}
+			}
+
+			T* objects[LOCAL_CAPACITY];
+			size_t size = 0;
+		};
+
+		static SharedStack& getSharedStack() {
+			static SharedStack stack;
+			return stack;
+		}
+
+		static LocalCache& getLocalCache() {
+			static thread_local LocalCache cache;
+			return cache;
+		}
+};
+
+#endif
@@ -46,6 +46,8 @@
 #include "scheduler.h"
 #include "raids.h"
 #include "databasetasks.h"
+#include "taskstats.h"
+#include "packetcrypto.h"
 
 extern Chat* g_chat;
 extern Game g_game;
@@ -1762,6 +1764,8 @@ void LuaScriptInterface::registerFunctions()
 	registerEnumIn("configKeys", ConfigManager::WARN_UNSAFE_SCRIPTS)
 	registerEnumIn("configKeys", ConfigManager::CONVERT_UNSAFE_SCRIPTS)
 	registerEnumIn("configKeys", ConfigManager::CLASSIC_EQUIPMENT_SLOTS)
+	registerEnumIn("configKeys", ConfigManager::DENSE_MAP_STORAGE)
+	registerEnumIn("configKeys", ConfigManager::WORLD_CACHE)
 
 	registerEnumIn("configKeys", ConfigManager::MAP_NAME)
 	registerEnumIn("configKeys", ConfigManager::HOUSE_RENT_PERIOD)
@@ -1809,6 +1813,10 @@ void LuaScriptInterface::registerFunctions()
 	registerEnumIn("configKeys", ConfigManager::STAIRHOP_DELAY)
 	registerEnumIn("configKeys", ConfigManager::EXP_FROM_PLAYERS_LEVEL_RANGE)
 	registerEnumIn("configKeys", ConfigManager::MAX_PACKETS_PER_SECOND)
+	registerEnumIn("configKeys", ConfigManager::GAME_TICK_INTERVAL)
+	registerEnumIn("configKeys", ConfigManager::TASK_STATS_LOG_INTERVAL)
+	registerEnumIn("configKeys", ConfigManager::PATHFINDER_THREADS)
+	registerEnumIn("configKeys", ConfigManager::NETWORK_THREADS)
 
 	// os
 	registerMethod("os", "mtime", LuaScriptInterface::luaSystemTime);
@@ -1827,6 +1835,10 @@ void LuaScriptInterface::registerFunctions()
 	registerMethod("Game", "getMonsterCount", LuaScriptInterface::luaGameGetMonsterCount);
 	registerMethod("Game", "getPlayerCount", LuaScriptInterface::luaGameGetPlayerCount);
 	registerMethod("Game", "getNpcCount", LuaScriptInterface::luaGameGetNpcCount);
+	registerMethod("Game", "getTaskHeapAllocations", LuaScriptInterface::luaGameGetTaskHeapAllocations);
+	registerMethod("Game", "getTaskStats", LuaScriptInterface::luaGameGetTaskStats);
+	registerMethod("Game", "resetTaskStats", LuaScriptInterface::luaGameResetTaskStats);
+	registerMethod("Game", "benchmarkPacketCrypto", LuaScriptInterface::luaGameBenchmarkPacketCrypto);
 
 	registerMethod("Game", "getTowns", LuaScriptInterface::luaGameGetTowns);
 	registerMethod("Game", "getHouses", LuaScriptInterface::luaGameGetHouses);
@@ -3982,7 +3994,7 @@ int LuaScriptInterface::luaAddEvent(lua_State* L)
 
 	auto& lastTimerEventId = g_luaEnvironment.m_lastEventTimerId;
 	eventDesc.eventId = g_scheduler.addEvent(createSchedulerTask(
-		delay, std::bind(&LuaEnvironment::executeTimerEvent, &g_luaEnvironment, lastTimerEventId)
+		delay, std::bind(&LuaEnvironment::executeTimerEvent, &g_luaEnvironment, lastTimerEventId), TASK_ORIGIN_LUA_EVENT
 	));
 
 	g_luaEnvironment.m_timerEvents.emplace(lastTimerEventId, std::move(eventDesc));
@@ -4047,6 +4059,8 @@ int LuaScriptInterface::luaSaveServer(lua_State* L)
 
 int LuaScriptInterface::luaCleanMap(lua_State* L)
 {
+	//cleanMap()
+	// returns the number of items queued for removal, see Map::clean
 	lua_pushnumber(L, g_game.map.clean());
 	return 1;
 }
@@ -4519,6 +4533,35 @@ int LuaScriptInterface::luaGameGetNpcCount(lua_State* L)
 	return 1;
 }
 
+int LuaScriptInterface::luaGameGetTaskHeapAllocations(lua_State* L)
+{
+	// Game.getTaskHeapAllocations()
+	lua_pushnumber(L, TaskFunc::getHeapAllocations());
+	return 1;
+}
+
+int LuaScriptInterface::luaGameGetTaskStats(lua_State* L)
+{
+	// Game.getTaskStats()
+	pushString(L, g_taskStats.getReport());
+	return 1;
+}
+
+int LuaScriptInterface::luaGameResetTaskStats(lua_State* L)
+{
+	// Game.resetTaskStats()
+	g_taskStats.reset();
+	pushBoolean(L, true);
+	return 1;
+}
+
+int LuaScriptInterface::luaGameBenchmarkPacketCrypto(lua_State* L)
+{
+	// Game.benchmarkPacketCrypto([megabytes = 16])
+	pushString(L, benchmarkPacketCrypto(getNumber<uint32_t>(L, 1, 16)));
+	return 1;
+}
+
 int LuaScriptInterface::luaGameGetTowns(lua_State* L)
 {
 	// Game.getTowns()
@@ -561,6 +561,10 @@ class LuaScriptInterface
 		static int luaGameGetMonsterCount(lua_State* L);
 		static int luaGameGetPlayerCount(lua_State* L);
 		static int luaGameGetNpcCount(lua_State* L);
+		static int luaGameGetTaskHeapAllocations(lua_State* L);
+		static int luaGameGetTaskStats(lua_State* L);
+		static int luaGameResetTaskStats(lua_State* L);
+		static int luaGameBenchmarkPacketCrypto(lua_State* L);
 
 		static int luaGameGetTowns(lua_State* L);
 		static int luaGameGetHouses(lua_State* L);
@@ -19,6 +19,8 @@
 
 #include "otpch.h"
 
+#include <queue>
+
 #include "iomap.h"
 #include "iomapserialize.h"
 #include "items.h"
@@ -27,26 +29,52 @@
 #include "combat.h"
 #include "creature.h"
 #include "game.h"
+#include "configmanager.h"
+#include "pathfinder.h"
+#include "scheduler.h"
+#include "monster.h"
+#include "worldcache.h"
 
 extern Game g_game;
+extern ConfigManager g_config;
+extern Scheduler g_scheduler;
 
 bool Map::loadMap(const std::string& identifier, bool loadHouses)
 {
-	IOMap loader;
-	if (!loader.loadMap(this, identifier)) {
-		std::cout << "[Fatal - Map::loadMap] " << loader.getLastErrorString() << std::endl;
+	denseStorage = g_config.getBoolean(ConfigManager::DENSE_MAP_STORAGE);
+
+	// only the main map is cached, it is the only one that loads houses
+	bool useCache = loadHouses && g_config.getBoolean(ConfigManager::WORLD_CACHE);
+
+	WorldCacheStatus cacheStatus = useCache ? WorldCache::load(*this, identifier) : WORLDCACHE_STALE;
+	if (cacheStatus == WORLDCACHE_ERROR) {
 		return false;
 	}
 
-	if (!IOMap::loadSpawns(this)) {
-		std::cout << "[Warning - Map::loadMap] Failed to load spawn data." << std::endl;
-	}
+	if (cacheStatus == WORLDCACHE_STALE) {
+		IOMap loader;
+		if (!loader.loadMap(this, identifier)) {
+			std::cout << "[Fatal - Map::loadMap] " << loader.getLastErrorString() << std::endl;
+			return false;
+		}
 
-	if (loadHouses) {
-		if (!IOMap::loadHouses(this)) {
+		bool cacheable = useCache;
+		if (!IOMap::loadSpawns(this)) {
+			std::cout << "[Warning - Map::loadMap] Failed to load spawn data." << std::endl;
+			cacheable = false;
+		}
+
+		if (loadHouses && !IOMap::loadHouses(this)) {
 			std::cout << "[Warning - Map::loadMap] Failed to load house data." << std::endl;
+			cacheable = false;
+		}
+
+		if (cacheable) {
+			WorldCache::save(*this, identifier);
 		}
+	}
 
+	if (loadHouses) {
 		IOMapSerialize::loadHouseInfo();
 		IOMapSerialize::loadHouseItems(this);
 	}
@@ -83,6 +111,20 @@ Tile* Map::getTile(uint16_t x, uint16_t y, uint8_t z) const
 		return nullptr;
 	}
 
+	if (denseStorage) {
+		uint32_t chunkX = x >> CHUNK_BITS;
+		uint32_t chunkY = y >> CHUNK_BITS;
+		if (chunkX >= chunksX || chunkY >= chunksY) {
+			return nullptr;
+		}
+
+		const Chunk* chunk = chunks[z][chunkY * chunksX + chunkX].get();
+		if (!chunk) {
+			return nullptr;
+		}
+		return chunk->tiles[x & CHUNK_MASK][y & CHUNK_MASK];
+	}
+
 	const QTreeLeafNode* leaf = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, x, y);
 	if (!leaf) {
 		return nullptr;
@@ -131,11 +173,16 @@ void Map::setTile(uint16_t x, uint16_t y, uint8_t z, Tile* newTile)
 		}
 	}
 
-	Floor* floor = leaf->createFloor(z);
-	uint32_t offsetX = x & FLOOR_MASK;
-	uint32_t offsetY = y & FLOOR_MASK;
+	Tile** tilePtr;
+	if (denseStorage) {
+		tilePtr = &createChunk(x, y, z)->tiles[x & CHUNK_MASK][y & CHUNK_MASK];
+	} else {
+		tilePtr = &leaf->createFloor(z)->tiles[x & FLOOR_MASK][y & FLOOR_MASK];
+	}
 
-	Tile*& tile = floor->tiles[offsetX][offsetY];
+	Tile*& tile = *tilePtr;
+	walkability.markDirty(x, y, z);
+	walkability.setGeneration(x, y, z, sightGeneration++);
 	if (tile) {
 		TileItemVector* items = newTile->getItemList();
 		if (items) {
@@ -156,6 +203,38 @@ void Map::setTile(uint16_t x, uint16_t y, uint8_t z, Tile* newTile)
 	}
 }
 
+Chunk* Map::createChunk(uint16_t x, uint16_t y, uint8_t z)
+{
+	uint32_t chunkX = x >> CHUNK_BITS;
+	uint32_t chunkY = y >> CHUNK_BITS;
+	if (chunkX >= chunksX || chunkY >= chunksY) {
+		// grow to the size in the map header right away, else double
+		uint32_t newChunksX = std::max<uint32_t>({chunkX + 1, chunksX * 2, (width + CHUNK_MASK) >> CHUNK_BITS});
+		uint32_t newChunksY = std::max<uint32_t>({chunkY + 1, chunksY * 2, (height + CHUNK_MASK) >> CHUNK_BITS});
+		newChunksX = std::min<uint32_t>(newChunksX, 0x10000 >> CHUNK_BITS);
+		newChunksY = std::min<uint32_t>(newChunksY, 0x10000 >> CHUNK_BITS);
+
+		for (std::vector<std::unique_ptr<Chunk>>& floorChunks : chunks) {
+			std::vector<std::unique_ptr<Chunk>> newFloorChunks(newChunksX * newChunksY);
+			for (uint32_t cy = 0; cy < chunksY; ++cy) {
+				for (uint32_t cx = 0; cx < chunksX; ++cx) {
+					newFloorChunks[cy * newChunksX + cx] = std::move(floorChunks[cy * chunksX + cx]);
+				}
+			}
+			floorChunks.swap(newFloorChunks);
+		}
+
+		chunksX = newChunksX;
+		chunksY = newChunksY;
+	}
+
+	std::unique_ptr<Chunk>& chunk = chunks[z][chunkY * chunksX + chunkX];
+	if (!chunk) {
+		chunk.reset(new Chunk);
+	}
+	return chunk.get();
+}
+
 bool Map::placeCreature(const Position& centerPos, Creature* creature, bool extendedPos/* = false*/, bool forceLogin/* = false*/)
 {
 	bool foundTile;
@@ -224,7 +303,8 @@ bool Map::placeCreature(const Position& centerPos, Creature* creature, bool exte
 	toCylinder->internalAddThing(creature);
 
 	const Position& dest = toCylinder->getPosition();
-	getQTNode(dest.x, dest.y)->addCreature(creature);
+	getQTNode(dest.x, dest.y)->addCreature(creature, dest.z);
+	updateSpectatorCache(*creature, nullptr, &dest);
 	return true;
 }
 
@@ -237,12 +317,12 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 
 	bool teleport = forceTeleport || !newTile.getGround() || !Position::areInRange<1, 1, 0>(oldPos, newPos);
 
-	SpectatorVec list;
-	getSpectators(list, oldPos, true);
-	getSpectators(list, newPos, true);
+	SpectatorBuffer list;
+	getSpectators(*list, oldPos, true);
+	getSpectators(*list, newPos, true);
 
 	std::vector<int32_t> oldStackPosVector;
-	for (Creature* spectator : list) {
+	for (Creature* spectator : *list) {
 		if (Player* tmpPlayer = spectator->getPlayer()) {
 			if (tmpPlayer->canSeeCreature(&creature)) {
 				oldStackPosVector.push_back(oldTile.getClientIndexOfCreature(tmpPlayer, &creature));
@@ -260,12 +340,15 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 
 	// Switch the node ownership
 	if (leaf != new_leaf) {
-		leaf->removeCreature(&creature);
-		new_leaf->addCreature(&creature);
+		leaf->removeCreature(&creature, oldPos.z);
+		new_leaf->addCreature(&creature, newPos.z);
+	} else if (oldPos.z != newPos.z) {
+		leaf->moveCreatureFloor(&creature, oldPos.z, newPos.z);
 	}
 
 	//add the creature
 	newTile.addThing(&creature);
+	updateSpectatorCache(creature, &oldPos, &newPos);
 
 	if (!teleport) {
 		if (oldPos.y > newPos.y) {
@@ -283,7 +366,7 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 
 	//send to client
 	size_t i = 0;
-	for (Creature* spectator : list) {
+	for (Creature* spectator : *list) {
 		if (Player* tmpPlayer = spectator->getPlayer()) {
 			//Use the correct stackpos
 			int32_t stackpos = oldStackPosVector[i++];
@@ -294,7 +377,7 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 	}
 
 	//event method
-	for (Creature* spectator : list) {
+	for (Creature* spectator : *list) {
 		spectator->onCreatureMove(&creature, &newTile, newPos, &oldTile, oldPos, teleport);
 	}
 
@@ -302,7 +385,8 @@ void Map::moveCreature(Creature& creature, Tile& newTile, bool forceTeleport/* =
 	newTile.postAddNotification(&creature, &oldTile, 0);
 }
 
-void Map::getSpectatorsInternal(SpectatorVec& list, const Position& centerPos, int32_t minRangeX, int32_t maxRangeX, int32_t minRangeY, int32_t maxRangeY, int32_t minRangeZ, int32_t maxRangeZ, bool onlyPlayers) const
+template <typename Container>
+void Map::getSpectatorsInternal(Container& list, const Position& centerPos, int32_t minRangeX, int32_t maxRangeX, int32_t minRangeY, int32_t maxRangeY, int32_t minRangeZ, int32_t maxRangeZ, bool onlyPlayers) const
 {
 	int_fast16_t min_y = centerPos.y + minRangeY;
 	int_fast16_t min_x = centerPos.x + minRangeX;
@@ -322,6 +406,9 @@ void Map::getSpectatorsInternal(SpectatorVec& list, const Position& centerPos, i
 	int32_t endx2 = x2 - (x2 % FLOOR_SIZE);
 	int32_t endy2 = y2 - (y2 % FLOOR_SIZE);
 
+	// floors in range, sectors without a creature on any of them are skipped as a whole
+	uint16_t floorMask = ((1 << (maxRangeZ + 1)) - 1) & ~((1 << minRangeZ) - 1);
+
 	const QTreeLeafNode* startLeaf = QTreeNode::getLeafStatic<const QTreeLeafNode*, const QTreeNode*>(&root, startx1, starty1);
 	const QTreeLeafNode* leafS = startLeaf;
 	const QTreeLeafNode* leafE;
@@ -333,7 +420,7 @@ void Map::getSpectatorsInternal(SpectatorVec& list, const Position& centerPos, i
 				const CreatureVector& node_list = (onlyPlayers ? leafE->player_list : leafE->creature_list);
 				CreatureVector::const_iterator node_iter = node_list.begin();
 				CreatureVector::const_iterator node_end = node_list.end();
-				if (node_iter != node_end) {
+				if ((onlyPlayers ? leafE->playerFloors : leafE->creatureFloors) & floorMask) {
 					do {
 						Creature* creature = *node_iter;
 
@@ -351,7 +438,7 @@ void Map::getSpectatorsInternal(SpectatorVec& list, const Position& centerPos, i
 							continue;
 						}
 
-						list.insert(creature);
+						list.push_back(creature);
 					} while (++node_iter != node_end);
 				}
 				leafE = leafE->m_leafE;
@@ -368,94 +455,221 @@ void Map::getSpectatorsInternal(SpectatorVec& list, const Position& centerPos, i
 	}
 }
 
+static void getSpectatorFloors(const Position& centerPos, bool multifloor, int32_t& minRangeZ, int32_t& maxRangeZ)
+{
+	if (multifloor) {
+		if (centerPos.z > 7) {
+			//underground
+
+			//8->15
+			minRangeZ = std::max<int32_t>(centerPos.getZ() - 2, 0);
+			maxRangeZ = std::min<int32_t>(centerPos.getZ() + 2, MAP_MAX_LAYERS - 1);
+		} else if (centerPos.z == 6) {
+			minRangeZ = 0;
+			maxRangeZ = 8;
+		} else if (centerPos.z == 7) {
+			minRangeZ = 0;
+			maxRangeZ = 9;
+		} else {
+			minRangeZ = 0;
+			maxRangeZ = 7;
+		}
+	} else {
+		minRangeZ = centerPos.z;
+		maxRangeZ = centerPos.z;
+	}
+}
+
 void Map::getSpectators(SpectatorVec& list, const Position& centerPos, bool multifloor /*= false*/, bool onlyPlayers /*= false*/, int32_t minRangeX /*= 0*/, int32_t maxRangeX /*= 0*/, int32_t minRangeY /*= 0*/, int32_t maxRangeY /*= 0*/)
 {
 	if (centerPos.z >= MAP_MAX_LAYERS) {
 		return;
 	}
 
-	bool foundCache = false;
-	bool cacheResult = false;
-
 	minRangeX = (minRangeX == 0 ? -maxViewportX : -minRangeX);
 	maxRangeX = (maxRangeX == 0 ? maxViewportX : maxRangeX);
 	minRangeY = (minRangeY == 0 ? -maxViewportY : -minRangeY);
 	maxRangeY = (maxRangeY == 0 ? maxViewportY : maxRangeY);
 
-	if (minRangeX == -maxViewportX && maxRangeX == maxViewportX && minRangeY == -maxViewportY && maxRangeY == maxViewportY && multifloor) {
-		if (onlyPlayers) {
-			auto it = playersSpectatorCache.find(centerPos);
-			if (it != playersSpectatorCache.end()) {
-				if (!list.empty()) {
-					const SpectatorVec& cachedList = *it->second;
-					list.insert(cachedList.begin(), cachedList.end());
-				} else {
-					list = *it->second;
-				}
+	int32_t minRangeZ;
+	int32_t maxRangeZ;
+	getSpectatorFloors(centerPos, multifloor, minRangeZ, maxRangeZ);
 
-				foundCache = true;
-			}
+	// a single scan never yields a creature twice, only merging into a filled list has to check
+	bool merge = !list.empty();
+
+	if (minRangeX != -maxViewportX || maxRangeX != maxViewportX || minRangeY != -maxViewportY || maxRangeY != maxViewportY) {
+		if (!merge) {
+			getSpectatorsInternal(list, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ, onlyPlayers);
+			return;
 		}
 
-		if (!foundCache) {
-			auto it = spectatorCache.find(centerPos);
-			if (it != spectatorCache.end()) {
-				if (!onlyPlayers) {
-					if (!list.empty()) {
-						const SpectatorVec& cachedList = *it->second;
-						list.insert(cachedList.begin(), cachedList.end());
-					} else {
-						list = *it->second;
-					}
-				} else {
-					const SpectatorVec& cachedList = *it->second;
-					for (Creature* spectator : cachedList) {
-						if (spectator->getPlayer()) {
-							list.insert(spectator);
-						}
-					}
-				}
+		SpectatorBuffer buffer;
+		getSpectatorsInternal(*buffer, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ, onlyPlayers);
+		for (Creature* creature : *buffer) {
+			list.insert(creature);
+		}
+		return;
+	}
 
-				foundCache = true;
-			} else {
-				cacheResult = true;
-			}
+	int32_t min_x = centerPos.x - maxViewportX;
+	int32_t max_x = centerPos.x + maxViewportX;
+	int32_t min_y = centerPos.y - maxViewportY;
+	int32_t max_y = centerPos.y + maxViewportY;
+
+	for (Creature* creature : getSpectatorCandidates(centerPos, multifloor, onlyPlayers, minRangeZ, maxRangeZ)) {
+		const Position& cpos = creature->getPosition();
+		int32_t offsetZ = Position::getOffsetZ(centerPos, cpos);
+		if (cpos.y < (min_y + offsetZ) || cpos.y > (max_y + offsetZ)) {
+			continue;
+		}
+
+		if (cpos.x < (min_x + offsetZ) || cpos.x > (max_x + offsetZ)) {
+			continue;
+		}
+
+		if (merge) {
+			list.insert(creature);
+		} else {
+			list.push_back(creature);
 		}
 	}
+}
 
-	if (!foundCache) {
-		int32_t minRangeZ;
-		int32_t maxRangeZ;
+const std::vector<Creature*>& Map::getSpectatorCandidates(const Position& centerPos, bool multifloor, bool onlyPlayers, int32_t minRangeZ, int32_t maxRangeZ)
+{
+	uint32_t key = (static_cast<uint32_t>(centerPos.x >> FLOOR_BITS) << 16) | (centerPos.y >> FLOOR_BITS);
 
-		if (multifloor) {
-			if (centerPos.z > 7) {
-				//underground
+	auto it = spectatorCache.find(key);
+	if (it == spectatorCache.end()) {
+		if (spectatorCache.size() >= maxSpectatorCacheSectors) {
+			clearSpectatorCache();
+		}
+		it = spectatorCache.emplace(key, std::vector<SpectatorCacheEntry>()).first;
+	}
 
-				//8->15
-				minRangeZ = std::max<int32_t>(centerPos.getZ() - 2, 0);
-				maxRangeZ = std::min<int32_t>(centerPos.getZ() + 2, MAP_MAX_LAYERS - 1);
-			} else if (centerPos.z == 6) {
-				minRangeZ = 0;
-				maxRangeZ = 8;
-			} else if (centerPos.z == 7) {
-				minRangeZ = 0;
-				maxRangeZ = 9;
-			} else {
-				minRangeZ = 0;
-				maxRangeZ = 7;
+	std::vector<SpectatorCacheEntry>& entries = it->second;
+
+	SpectatorCacheEntry* entry = nullptr;
+	for (SpectatorCacheEntry& sectorEntry : entries) {
+		if (sectorEntry.z == centerPos.z && sectorEntry.multifloor == multifloor && sectorEntry.onlyPlayers == onlyPlayers) {
+			entry = &sectorEntry;
+			break;
+		}
+	}
+
+	if (!entry) {
+		entries.emplace_back(centerPos.z, multifloor, onlyPlayers);
+		entry = &entries.back();
+		entry->minRangeZ = minRangeZ;
+		entry->maxRangeZ = maxRangeZ;
+	}
+
+	if (!entry->valid) {
+		// the viewport of every position in the sector
+		Position sectorPos(centerPos.x & ~FLOOR_MASK, centerPos.y & ~FLOOR_MASK, centerPos.z);
+
+		entry->creatures.clear();
+		getSpectatorsInternal(entry->creatures, sectorPos, -maxViewportX, maxViewportX + FLOOR_MASK,
+		                      -maxViewportY, maxViewportY + FLOOR_MASK, minRangeZ, maxRangeZ, onlyPlayers);
+		entry->valid = true;
+	}
+	return entry->creatures;
+}
+
+static bool isInSpectatorSector(uint32_t key, const SpectatorCacheEntry& entry, const Position* pos)
+{
+	if (!pos || pos->z < entry.minRangeZ || pos->z > entry.maxRangeZ) {
+		return false;
+	}
+
+	int32_t offsetZ = entry.z - pos->z;
+
+	int32_t min_x = static_cast<int32_t>(key >> 16) * FLOOR_SIZE - Map::maxViewportX + offsetZ;
+	if (pos->x < min_x || pos->x > min_x + Map::maxViewportX * 2 + FLOOR_MASK) {
+		return false;
+	}
+
+	int32_t min_y = static_cast<int32_t>(key & 0xFFFF) * FLOOR_SIZE - Map::maxViewportY + offsetZ;
+	return pos->y >= min_y && pos->y <= min_y + Map::maxViewportY * 2 + FLOOR_MASK;
+}
+
+void Map::updateSpectatorCache(const Creature& creature, const Position* oldPos, const Position* newPos)
+{
+	if (spectatorCache.empty()) {
+		return;
+	}
+
+	// a multifloor view is shifted by at most one tile per floor
+	static const int32_t maxOffsetZ = 7;
+
+	// sectors whose candidates can include a position
+	auto getSectors = [](const Position& pos, int32_t (&sectors)[4]) {
+		sectors[0] = std::max<int32_t>(0, pos.x - maxViewportX - FLOOR_MASK - maxOffsetZ) >> FLOOR_BITS;
+		sectors[1] = std::max<int32_t>(0, pos.y - maxViewportY - FLOOR_MASK - maxOffsetZ) >> FLOOR_BITS;
+		sectors[2] = std::min<int32_t>(0xFFFF, pos.x + maxViewportX + maxOffsetZ) >> FLOOR_BITS;
+		sectors[3] = std::min<int32_t>(0xFFFF, pos.y + maxViewportY + maxOffsetZ) >> FLOOR_BITS;
+	};
+
+	bool isPlayer = creature.getPlayer() != nullptr;
+
+	int32_t oldSectors[4];
+	int32_t newSectors[4];
+	if (oldPos) {
+		getSectors(*oldPos, oldSectors);
+	}
+
+	if (newPos) {
+		getSectors(*newPos, newSectors);
+	}
+
+	if (oldPos && newPos && Position::areInRange<FLOOR_SIZE, FLOOR_SIZE>(*oldPos, *newPos)) {
+		// walking, both areas mostly overlap
+		oldSectors[0] = std::min(oldSectors[0], newSectors[0]);
+		oldSectors[1] = std::min(oldSectors[1], newSectors[1]);
+		oldSectors[2] = std::max(oldSectors[2], newSectors[2]);
+		oldSectors[3] = std::max(oldSectors[3], newSectors[3]);
+		invalidateSpectatorSectors(oldSectors, isPlayer, oldPos, newPos);
+		return;
+	}
+
+	if (oldPos) {
+		invalidateSpectatorSectors(oldSectors, isPlayer, oldPos, newPos);
+	}
+
+	if (newPos) {
+		invalidateSpectatorSectors(newSectors, isPlayer, oldPos, newPos);
+	}
+}
+
+void Map::invalidateSpectatorSectors(const int32_t (&sectors)[4], bool isPlayer, const Position* oldPos, const Position* newPos)
+{
+	auto invalidate = [isPlayer, oldPos, newPos](uint32_t key, std::vector<SpectatorCacheEntry>& entries) {
+		for (SpectatorCacheEntry& entry : entries) {
+			if (!entry.valid || (entry.onlyPlayers && !isPlayer)) {
+				continue;
+			}
+
+			// moving around inside the area of a sector does not change its candidates
+			if (isInSpectatorSector(key, entry, oldPos) != isInSpectatorSector(key, entry, newPos)) {
+				entry.valid = false;
 			}
-		} else {
-			minRangeZ = centerPos.z;
-			maxRangeZ = centerPos.z;
 		}
+	};
 
-		getSpectatorsInternal(list, centerPos, minRangeX, maxRangeX, minRangeY, maxRangeY, minRangeZ, maxRangeZ, onlyPlayers);
+	if (static_cast<size_t>((sectors[2] - sectors[0] + 1) * (sectors[3] - sectors[1] + 1)) >= spectatorCache.size()) {
+		for (auto& it : spectatorCache) {
+			invalidate(it.first, it.second);
+		}
+		return;
+	}
 
-		if (cacheResult) {
-			if (onlyPlayers) {
-				playersSpectatorCache[centerPos] = std::make_shared<SpectatorVec>(list);
-			} else {
-				spectatorCache[centerPos] = std::make_shared<SpectatorVec>(list);
+	for (int32_t sx = sectors[0]; sx <= sectors[2]; ++sx) {
+		for (int32_t sy = sectors[1]; sy <= sectors[3]; ++sy) {
+			uint32_t key = (static_cast<uint32_t>(sx) << 16) | sy;
+			auto it = spectatorCache.find(key);
+			if (it != spectatorCache.end()) {
+				invalidate(key, it->second);
 			}
 		}
 	}
@@ -464,7 +678,6 @@ void Map::getSpectators(SpectatorVec& list, const Position& centerPos, bool mult
 void Map::clearSpectatorCache()
 {
 	spectatorCache.clear();
-	playersSpectatorCache.clear();
 }
 
 bool Map::canThrowObjectTo(const Position& fromPos, const Position& toPos, bool checkLineOfSight /*= true*/,
@@ -506,30 +719,14 @@ bool Map::checkSightLine(const Position& fromPos, const Position& toPos) const
 	Position start(fromPos.z > toPos.z ? toPos : fromPos);
 	Position destination(fromPos.z > toPos.z ? fromPos : toPos);
 
-	const int8_t mx = start.x < destination.x ? 1 : start.x == destination.x ? 0 : -1;
-	const int8_t my = start.y < destination.y ? 1 : start.y == destination.y ? 0 : -1;
-
-	int32_t A = Position::getOffsetY(destination, start);
-	int32_t B = Position::getOffsetX(start, destination);
-	int32_t C = -(A * destination.x + B * destination.y);
-
-	while (start.x != destination.x || start.y != destination.y) {
-		int32_t move_hor = std::abs(A * (start.x + mx) + B * (start.y) + C);
-		int32_t move_ver = std::abs(A * (start.x) + B * (start.y + my) + C);
-		int32_t move_cross = std::abs(A * (start.x + mx) + B * (start.y + my) + C);
-
-		if (start.y != destination.y && (start.x == destination.x || move_hor > move_ver || move_hor > move_cross)) {
-			start.y += my;
-		}
+	bool blocked = false;
+	start = walkSightLine(start, destination, [this, &blocked](const Position& pos) {
+		blocked = (getWalkability(pos.x, pos.y, pos.z) & WALKABILITY_BLOCKPROJECTILE) != 0;
+		return blocked;
+	});
 
-		if (start.x != destination.x && (start.y == destination.y || move_ver > move_hor || move_ver > move_cross)) {
-			start.x += mx;
-		}
-
-		const Tile* tile = getTile(start.x, start.y, start.z);
-		if (tile && tile->hasProperty(CONST_PROP_BLOCKPROJECTILE)) {
-			return false;
-		}
+	if (blocked) {
+		return false;
 	}
 
 	// now we need to perform a jump between floors to see if everything is clear (literally)
@@ -547,12 +744,37 @@ bool Map::checkSightLine(const Position& fromPos, const Position& toPos) const
 
 bool Map::isSightClear(const Position& fromPos, const Position& toPos, bool floorCheck) const
 {
-	if (floorCheck && fromPos.z != toPos.z) {
-		return false;
+	if (fromPos.z != toPos.z) {
+		if (floorCheck) {
+			return false;
+		}
+
+		// Cast two converging rays and see if either yields a result.
+		return checkSightLine(fromPos, toPos) || checkSightLine(toPos, fromPos);
 	}
 
-	// Cast two converging rays and see if either yields a result.
-	return checkSightLine(fromPos, toPos) || checkSightLine(toPos, fromPos);
+	// both rays together are symmetric, so one entry serves both directions
+	const Position& lowPos = (fromPos.x < toPos.x || (fromPos.x == toPos.x && fromPos.y < toPos.y)) ? fromPos : toPos;
+	const Position& highPos = (&lowPos == &fromPos) ? toPos : fromPos;
+	const uint64_t key = (static_cast<uint64_t>(lowPos.x) << 48) | (static_cast<uint64_t>(lowPos.y) << 32) |
+	                     (static_cast<uint64_t>(highPos.x) << 16) | highPos.y;
+
+	const uint16_t minY = std::min(fromPos.y, toPos.y);
+	const uint16_t maxY = std::max(fromPos.y, toPos.y);
+
+	// the rays never leave the rectangle between both positions, the entry
+	// holds as long as every chunk under it was last changed before it
+	SightCacheEntry& entry = sightCache[((key * 0x9E3779B97F4A7C15ULL) >> (64 - SIGHT_CACHE_BITS)) ^ fromPos.z];
+	if (entry.key == key && entry.z == fromPos.z &&
+	        entry.generation > walkability.getGeneration(lowPos.x, minY, highPos.x, maxY, fromPos.z)) {
+		return entry.clear;
+	}
+
+	entry.key = key;
+	entry.z = fromPos.z;
+	entry.generation = sightGeneration;
+	entry.clear = checkSightLine(fromPos, toPos) || checkSightLine(toPos, fromPos);
+	return entry.clear;
 }
 
 const Tile* Map::canWalkTo(const Creature& creature, const Position& pos) const
@@ -565,6 +787,10 @@ const Tile* Map::canWalkTo(const Creature& creature, const Position& pos) const
 	}
 
 	//used for non-cached tiles
+	if (pos != creature.getPosition() && isPathBlocked(creature, pos)) {
+		return nullptr;
+	}
+
 	Tile* tile = getTile(pos.x, pos.y, pos.z);
 	if (creature.getTile() != tile) {
 		if (!tile || tile->queryAdd(0, creature, 1, FLAG_PATHFINDING | FLAG_IGNOREFIELDDAMAGE) != RETURNVALUE_NOERROR) {
@@ -574,12 +800,466 @@ const Tile* Map::canWalkTo(const Creature& creature, const Position& pos) const
 	return tile;
 }
 
+static uint16_t getTileWalkability(const Tile* tile)
+{
+	uint16_t flags = WALKABILITY_NONE;
+	if (tile->getGround()) {
+		flags |= WALKABILITY_GROUND;
+	}
+
+	if (tile->hasFlag(TILESTATE_BLOCKSOLID)) {
+		flags |= WALKABILITY_BLOCKSOLID;
+	}
+
+	if (tile->hasFlag(TILESTATE_BLOCKPATH)) {
+		flags |= WALKABILITY_BLOCKPATH;
+	}
+
+	if (tile->hasProperty(CONST_PROP_BLOCKPROJECTILE)) {
+		flags |= WALKABILITY_BLOCKPROJECTILE;
+	}
+
+	if (tile->hasFlag(TILESTATE_PROTECTIONZONE)) {
+		flags |= WALKABILITY_PROTECTIONZONE;
+	}
+
+	if (tile->floorChange() || tile->positionChange()) {
+		flags |= WALKABILITY_FLOORCHANGE;
+	}
+
+	if (tile->hasFlag(TILESTATE_IMMOVABLEBLOCKSOLID)) {
+		flags |= WALKABILITY_IMMOVABLEBLOCKSOLID;
+	}
+
+	if (tile->hasFlag(TILESTATE_IMMOVABLENOFIELDBLOCKPATH)) {
+		flags |= WALKABILITY_IMMOVABLENOFIELDBLOCKPATH;
+	}
+
+	if (tile->hasFlag(TILESTATE_NOFIELDBLOCKPATH)) {
+		flags |= WALKABILITY_NOFIELDBLOCKPATH;
+	}
+
+	if (tile->hasFlag(TILESTATE_MAGICFIELD)) {
+		flags |= WALKABILITY_MAGICFIELD;
+	}
+
+	if (tile->hasFlag(TILESTATE_HOUSE)) {
+		flags |= WALKABILITY_HOUSE;
+	}
+	return flags;
+}
+
+uint16_t Map::getWalkability(uint16_t x, uint16_t y, uint8_t z) const
+{
+	uint16_t flags = walkability.getFlags(x, y, z);
+	if (flags & WALKABILITY_DIRTY) {
+		const Tile* tile = getTile(x, y, z);
+		flags = tile ? getTileWalkability(tile) : WALKABILITY_NONE;
+		walkability.setFlags(x, y, z, flags);
+	}
+	return flags;
+}
+
+void Map::updateWalkability(const Tile* tile)
+{
+	const Position& pos = tile->getPosition();
+	if (getTile(pos.x, pos.y, pos.z) != tile) {
+		// still being loaded, setTile marks the position dirty once it is placed
+		return;
+	}
+
+	const uint16_t oldFlags = walkability.getFlags(pos.x, pos.y, pos.z);
+	const uint16_t newFlags = getTileWalkability(tile);
+	if (oldFlags == newFlags) {
+		return;
+	}
+
+	walkability.setFlags(pos.x, pos.y, pos.z, newFlags);
+	pathGraph.markDirty(pos.x, pos.y, pos.z);
+	if ((oldFlags ^ newFlags) & (WALKABILITY_DIRTY | WALKABILITY_BLOCKPROJECTILE)) {
+		walkability.setGeneration(pos.x, pos.y, pos.z, sightGeneration++);
+	}
+
+	// flow fields only read what isPathBlocked and the sight checks look at
+	static const uint16_t flowFieldFlags = WALKABILITY_DIRTY | WALKABILITY_GROUND | WALKABILITY_BLOCKSOLID |
+	                                       WALKABILITY_BLOCKPROJECTILE | WALKABILITY_PROTECTIONZONE | WALKABILITY_FLOORCHANGE |
+	                                       WALKABILITY_IMMOVABLEBLOCKSOLID | WALKABILITY_IMMOVABLENOFIELDBLOCKPATH | WALKABILITY_HOUSE;
+	if ((oldFlags ^ newFlags) & flowFieldFlags) {
+		invalidateFlowFields(pos);
+	}
+}
+
+bool Map::isPathBlocked(const Creature& creature, const Position& pos) const
+{
+	return isPathBlocked(getWalkability(pos.x, pos.y, pos.z), getPathClass(creature));
+}
+
+bool Map::isPathBlocked(uint16_t flags, PathClass_t pathClass)
+{
+	// mirrors the item and tile checks of Tile::queryAdd with FLAG_PATHFINDING
+	if (!(flags & WALKABILITY_GROUND) || (flags & WALKABILITY_FLOORCHANGE)) {
+		return true;
+	}
+
+	if (pathClass != PATHCLASS_CREATURE) {
+		if (flags & (WALKABILITY_PROTECTIONZONE | WALKABILITY_HOUSE | WALKABILITY_IMMOVABLEBLOCKSOLID | WALKABILITY_IMMOVABLENOFIELDBLOCKPATH)) {
+			return true;
+		}
+		return (flags & WALKABILITY_BLOCKSOLID) && pathClass != PATHCLASS_MONSTER_PUSHITEMS;
+	}
+	return (flags & WALKABILITY_BLOCKSOLID) != 0;
+}
+
+PathClass_t Map::getPathClass(const Creature& creature)
+{
+	const Monster* monster = creature.getMonster();
+	if (!monster) {
+		return PATHCLASS_CREATURE;
+	}
+	return monster->canPushItems() ? PATHCLASS_MONSTER_PUSHITEMS : PATHCLASS_MONSTER;
+}
+
+static const int_fast32_t flowFieldSteps[8][3] = {
+	{0, -1, DIRECTION_NORTH}, {1, 0, DIRECTION_EAST}, {0, 1, DIRECTION_SOUTH}, {-1, 0, DIRECTION_WEST},
+	{-1, 1, DIRECTION_SOUTHWEST}, {1, 1, DIRECTION_SOUTHEAST}, {-1, -1, DIRECTION_NORTHWEST}, {1, -1, DIRECTION_NORTHEAST}
+};
+
+const FlowField* Map::getFlowField(const Creature& target, PathClass_t pathClass) const
+{
+	const int64_t now = OTSYS_TIME();
+	const uint64_t key = (static_cast<uint64_t>(target.getID()) << 8) | pathClass;
+
+	const Position& targetPos = target.getPosition();
+
+	auto it = flowFields.find(key);
+	if (it == flowFields.end()) {
+		if (flowFields.size() >= maxFlowFields) {
+			// drop the fields of targets nobody chased lately
+			for (auto fieldIt = flowFields.begin(); fieldIt != flowFields.end();) {
+				if (now - fieldIt->second.lastUsed >= 10000) {
+					unindexFlowField(fieldIt->first, fieldIt->second.center);
+					fieldIt = flowFields.erase(fieldIt);
+				} else {
+					++fieldIt;
+				}
+			}
+
+			if (flowFields.size() >= maxFlowFields) {
+				return nullptr;
+			}
+		}
+
+		it = flowFields.emplace(key, FlowField()).first;
+		it->second.center = targetPos;
+		it->second.pathClass = pathClass;
+		it->second.valid = false;
+		indexFlowField(key, targetPos);
+	}
+
+	FlowField& field = it->second;
+	field.lastUsed = now;
+	if (field.center != targetPos) {
+		if ((field.center.x >> WALKABILITY_CHUNK_BITS) != (targetPos.x >> WALKABILITY_CHUNK_BITS) ||
+		        (field.center.y >> WALKABILITY_CHUNK_BITS) != (targetPos.y >> WALKABILITY_CHUNK_BITS)) {
+			unindexFlowField(key, field.center);
+			indexFlowField(key, targetPos);
+		}
+		field.center = targetPos;
+		field.valid = false;
+	}
+
+	if (!field.valid) {
+		buildFlowField(field);
+	}
+	return &field;
+}
+
+void Map::buildFlowField(FlowField& field) const
+{
+	std::fill(&field.cost[0][0], &field.cost[0][0] + FLOW_FIELD_SIZE * FLOW_FIELD_SIZE, FLOW_FIELD_UNREACHABLE);
+	field.valid = true;
+
+	const Position& center = field.center;
+	auto isOpen = [&](int_fast32_t x, int_fast32_t y) {
+		if (x == FLOW_FIELD_RADIUS && y == FLOW_FIELD_RADIUS) {
+			return false; // the target itself stands there
+		}
+
+		const int_fast32_t mapX = center.x + x - FLOW_FIELD_RADIUS;
+		const int_fast32_t mapY = center.y + y - FLOW_FIELD_RADIUS;
+		if (mapX < 0 || mapX > 0xFFFF || mapY < 0 || mapY > 0xFFFF) {
+			return false;
+		}
+		return !isPathBlocked(getWalkability(mapX, mapY, center.z), field.pathClass);
+	};
+
+	// dijkstra from the tiles a melee follower wants to stand on outwards,
+	// walk costs are symmetric so this is the cost of walking towards them
+	typedef std::pair<uint_fast32_t, uint_fast32_t> QueueEntry; // cost, y * size + x
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+	for (const auto& step : flowFieldSteps) {
+		const int_fast32_t x = FLOW_FIELD_RADIUS + step[0];
+		const int_fast32_t y = FLOW_FIELD_RADIUS + step[1];
+		if (!isOpen(x, y)) {
+			continue;
+		}
+
+		const Position pos(center.x + step[0], center.y + step[1], center.z);
+		if (!isSightClear(pos, center, true)) {
+			continue;
+		}
+
+		field.cost[y][x] = 0;
+		queue.emplace(0, y * FLOW_FIELD_SIZE + x);
+	}
+
+	while (!queue.empty()) {
+		const QueueEntry entry = queue.top();
+		queue.pop();
+
+		const int_fast32_t x = entry.second % FLOW_FIELD_SIZE;
+		const int_fast32_t y = entry.second / FLOW_FIELD_SIZE;
+		if (entry.first != field.cost[y][x]) {
+			continue;
+		}
+
+		for (const auto& step : flowFieldSteps) {
+			const int_fast32_t nx = x + step[0];
+			const int_fast32_t ny = y + step[1];
+			if (nx < 0 || nx >= FLOW_FIELD_SIZE || ny < 0 || ny >= FLOW_FIELD_SIZE) {
+				continue;
+			}
+
+			const uint_fast32_t cost = entry.first + (step[0] != 0 && step[1] != 0 ? MAP_DIAGONALWALKCOST : MAP_NORMALWALKCOST);
+			if (cost >= field.cost[ny][nx] || !isOpen(nx, ny)) {
+				continue;
+			}
+
+			field.cost[ny][nx] = cost;
+			queue.emplace(cost, ny * FLOW_FIELD_SIZE + nx);
+		}
+	}
+}
+
+void Map::invalidateFlowFields(const Position& pos)
+{
+	if (flowFields.empty()) {
+		return;
+	}
+
+	// a field reaches FLOW_FIELD_RADIUS + 1 tiles from its center, which is
+	// less than a chunk, so only fields centered in the neighbouring chunks
+	// can depend on pos
+	const int32_t chunkX = pos.x >> WALKABILITY_CHUNK_BITS;
+	const int32_t chunkY = pos.y >> WALKABILITY_CHUNK_BITS;
+	for (int32_t y = std::max<int32_t>(0, chunkY - 1); y <= chunkY + 1; ++y) {
+		for (int32_t x = std::max<int32_t>(0, chunkX - 1); x <= chunkX + 1; ++x) {
+			auto sectorIt = flowFieldIndex.find((static_cast<uint32_t>(x) << 16) | y);
+			if (sectorIt == flowFieldIndex.end()) {
+				continue;
+			}
+
+			for (uint64_t key : sectorIt->second) {
+				FlowField& field = flowFields.find(key)->second;
+				if (field.valid && field.center.z == pos.z &&
+				        Position::getDistanceX(field.center, pos) <= FLOW_FIELD_RADIUS + 1 &&
+				        Position::getDistanceY(field.center, pos) <= FLOW_FIELD_RADIUS + 1) {
+					field.valid = false;
+				}
+			}
+		}
+	}
+}
+
+void Map::indexFlowField(uint64_t key, const Position& center) const
+{
+	const uint32_t sector = ((center.x >> WALKABILITY_CHUNK_BITS) << 16) | (center.y >> WALKABILITY_CHUNK_BITS);
+	flowFieldIndex[sector].push_back(key);
+}
+
+void Map::unindexFlowField(uint64_t key, const Position& center) const
+{
+	const uint32_t sector = ((center.x >> WALKABILITY_CHUNK_BITS) << 16) | (center.y >> WALKABILITY_CHUNK_BITS);
+	auto it = flowFieldIndex.find(sector);
+	if (it == flowFieldIndex.end()) {
+		return;
+	}
+
+	std::vector<uint64_t>& keys = it->second;
+	auto keyIt = std::find(keys.begin(), keys.end(), key);
+	if (keyIt != keys.end()) {
+		*keyIt = keys.back();
+		keys.pop_back();
+	}
+
+	if (keys.empty()) {
+		flowFieldIndex.erase(it);
+	}
+}
+
+bool Map::getFollowPath(const Creature& creature, const Creature& target, std::forward_list<Direction>& dirList, const FindPathParams& fpp) const
+{
+	// only the plain melee chase is shared, everything else depends on the follower
+	if (!fpp.fullPathSearch || !fpp.clearSight || !fpp.allowDiagonal || fpp.keepDistance ||
+	        fpp.minTargetDist != 1 || fpp.maxTargetDist != 1) {
+		return false;
+	}
+
+	const Position& startPos = creature.getPosition();
+	const Position& targetPos = target.getPosition();
+	if (startPos.z != targetPos.z ||
+	        Position::getDistanceX(startPos, targetPos) > FLOW_FIELD_RADIUS ||
+	        Position::getDistanceY(startPos, targetPos) > FLOW_FIELD_RADIUS) {
+		return false;
+	}
+
+	const FlowField* field = getFlowField(target, getPathClass(creature));
+	if (!field) {
+		return false;
+	}
+
+	int_fast32_t x = FLOW_FIELD_RADIUS + Position::getOffsetX(startPos, targetPos);
+	int_fast32_t y = FLOW_FIELD_RADIUS + Position::getOffsetY(startPos, targetPos);
+	uint_fast32_t cost = field->cost[y][x];
+	if (cost == FLOW_FIELD_UNREACHABLE) {
+		return false;
+	}
+
+	// walk downhill, any neighbor on a cheapest path will do as long as this
+	// creature can step there without extra cost, otherwise let the A* decide
+	std::vector<Direction> path;
+	Position pos = startPos;
+	while (cost != 0) {
+		bool stepped = false;
+		for (const auto& step : flowFieldSteps) {
+			const int_fast32_t nx = x + step[0];
+			const int_fast32_t ny = y + step[1];
+			if (nx < 0 || nx >= FLOW_FIELD_SIZE || ny < 0 || ny >= FLOW_FIELD_SIZE) {
+				continue;
+			}
+
+			const uint_fast32_t stepCost = (step[0] != 0 && step[1] != 0 ? MAP_DIAGONALWALKCOST : MAP_NORMALWALKCOST);
+			if (field->cost[ny][nx] + stepCost != cost) {
+				continue;
+			}
+
+			const Position nextPos(pos.x + step[0], pos.y + step[1], pos.z);
+			if (fpp.maxSearchDist != 0 && (Position::getDistanceX(startPos, nextPos) > fpp.maxSearchDist || Position::getDistanceY(startPos, nextPos) > fpp.maxSearchDist)) {
+				continue;
+			}
+
+			const Tile* tile = canWalkTo(creature, nextPos);
+			if (!tile || AStarNodes::getTileWalkCost(creature, tile) != 0) {
+				continue;
+			}
+
+			path.push_back(static_cast<Direction>(step[2]));
+			pos = nextPos;
+			x = nx;
+			y = ny;
+			cost = field->cost[ny][nx];
+			stepped = true;
+			break;
+		}
+
+		if (!stepped) {
+			return false;
+		}
+	}
+
+	dirList.assign(path.begin(), path.end());
+	return true;
+}
+
+bool Map::getLongPath(const Creature& creature, const Position& targetPos, std::forward_list<Direction>& dirList, const FindPathParams& fpp) const
+{
+	// bounded searches stay with the regular A*, they never leave the start area
+	const Position& startPos = creature.getPosition();
+	if (fpp.maxSearchDist != 0 || fpp.keepDistance || startPos.z != targetPos.z ||
+	        std::max<int32_t>(Position::getDistanceX(startPos, targetPos), Position::getDistanceY(startPos, targetPos)) <= PATH_CLUSTER_SIZE) {
+		return false;
+	}
+
+	std::vector<Position> waypoints;
+	if (!pathGraph.findWaypoints(*this, getPathClass(creature), startPos, targetPos, waypoints)) {
+		return false;
+	}
+
+	FindPathParams legParams;
+	legParams.fullPathSearch = true;
+	legParams.clearSight = false;
+	legParams.allowDiagonal = fpp.allowDiagonal;
+	legParams.maxSearchDist = PATH_CLUSTER_SIZE;
+	legParams.minTargetDist = 0;
+	legParams.maxTargetDist = 0;
+
+	std::vector<Direction> path;
+	std::forward_list<Direction> leg;
+	Position legStart = startPos;
+	for (const Position& waypoint : waypoints) {
+		leg.clear();
+		if (!getPathMatching(creature, legStart, leg, FrozenPathingConditionCall(waypoint), legParams)) {
+			return false;
+		}
+		path.insert(path.end(), leg.begin(), leg.end());
+		legStart = waypoint;
+	}
+
+	// the last leg is the only one that has to match the caller's conditions
+	FindPathParams lastParams = fpp;
+	lastParams.maxSearchDist = PATH_CLUSTER_SIZE * 2;
+
+	leg.clear();
+	if (!getPathMatching(creature, legStart, leg, FrozenPathingConditionCall(targetPos), lastParams)) {
+		return false;
+	}
+	path.insert(path.end(), leg.begin(), leg.end());
+
+	dirList.assign(path.begin(), path.end());
+	return true;
+}
+
 bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>& dirList, const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const
 {
-	Position pos = creature.getPosition();
+	return getPathMatching(creature, creature.getPosition(), dirList, pathCondition, fpp);
+}
+
+// Path search through the live map, asks the tiles themselves
+class MapPathWalker
+{
+	public:
+		MapPathWalker(const Map& map, const Creature& creature) : map(map), creature(creature) {}
+
+		bool isMatch(const FrozenPathingConditionCall& pathCondition, const Position& startPos, const Position& testPos,
+		             const FindPathParams& fpp, int32_t& bestMatchDist) const {
+			return pathCondition(startPos, testPos, fpp, bestMatchDist);
+		}
+
+		// a position that is already known to the search only needs its cost
+		bool getWalkCost(const Position& pos, bool known, int_fast32_t& extraCost) const {
+			const Tile* tile = known ? map.getTile(pos.x, pos.y, pos.z) : map.canWalkTo(creature, pos);
+			if (!tile) {
+				return false;
+			}
+
+			extraCost = AStarNodes::getTileWalkCost(creature, tile);
+			return true;
+		}
+
+	private:
+		const Map& map;
+		const Creature& creature;
+};
+
+template <typename PathWalker>
+static bool findPathMatching(PathWalker& walker, const Position& startPos, std::forward_list<Direction>& dirList, const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp)
+{
+	Position pos = startPos;
 	Position endPos;
 
-	AStarNodes nodes(pos.x, pos.y);
+	static thread_local AStarNodes nodes;
+	nodes.reset(pos.x, pos.y);
 
 	int32_t bestMatch = 0;
 
@@ -597,8 +1277,6 @@ bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>
 		{-1, 0}, {0, 1}, {1, 0}, {0, -1}, {-1, -1}, {1, -1}, {1, 1}, {-1, 1}
 	};
 
-	const Position startPos = pos;
-
 	AStarNode* found = nullptr;
 	while (fpp.maxSearchDist != 0 || nodes.getClosedNodes() < 100) {
 		AStarNode* n = nodes.getBestNode();
@@ -613,7 +1291,7 @@ bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>
 		const int_fast32_t y = n->y;
 		pos.x = x;
 		pos.y = y;
-		if (pathCondition(startPos, pos, fpp, bestMatch)) {
+		if (walker.isMatch(pathCondition, startPos, pos, fpp, bestMatch)) {
 			found = n;
 			endPos = pos;
 			if (bestMatch == 0) {
@@ -668,20 +1346,14 @@ bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>
 				continue;
 			}
 
-			const Tile* tile;
+			int_fast32_t extraCost;
 			AStarNode* neighborNode = nodes.getNodeByPosition(pos.x, pos.y);
-			if (neighborNode) {
-				tile = getTile(pos.x, pos.y, pos.z);
-			} else {
-				tile = canWalkTo(creature, pos);
-				if (!tile) {
-					continue;
-				}
+			if (!walker.getWalkCost(pos, neighborNode != nullptr, extraCost)) {
+				continue;
 			}
 
 			//The cost (g) for this neighbor
 			const int_fast32_t cost = AStarNodes::getMapWalkCost(n, pos);
-			const int_fast32_t extraCost = AStarNodes::getTileWalkCost(creature, tile);
 			const int_fast32_t newf = f + cost + extraCost;
 
 			if (neighborNode) {
@@ -749,21 +1421,72 @@ bool Map::getPathMatching(const Creature& creature, std::forward_list<Direction>
 	return true;
 }
 
+bool Map::getPathMatching(const Creature& creature, const Position& startPos, std::forward_list<Direction>& dirList, const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const
+{
+	MapPathWalker walker(*this, creature);
+	return findPathMatching(walker, startPos, dirList, pathCondition, fpp);
+}
+
+bool Map::getPathMatching(const PathSnapshot& snapshot, std::forward_list<Direction>& dirList, const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp)
+{
+	return findPathMatching(snapshot, snapshot.getStartPos(), dirList, pathCondition, fpp);
+}
+
 // AStarNodes
 
-AStarNodes::AStarNodes(uint32_t x, uint32_t y)
-	: openNodes()
+AStarNodes::AStarNodes()
+	: openCount(0), nodeGrid(), gridX(0), gridY(0), curNode(0), closedNodes(0) {}
+
+void AStarNodes::reset(uint32_t x, uint32_t y)
 {
+	// only clear what the previous search touched
+	for (size_t i = 0; i < curNode; ++i) {
+		uint16_t* cell = getGridCell(nodes[i].x, nodes[i].y);
+		if (cell) {
+			*cell = 0;
+		}
+	}
+
+	if (!farNodes.empty()) {
+		farNodes.clear();
+	}
+
+	gridX = x - ASTAR_GRID_SIZE / 2;
+	gridY = y - ASTAR_GRID_SIZE / 2;
+
 	curNode = 1;
 	closedNodes = 0;
-	openNodes[0] = true;
 
 	AStarNode& startNode = nodes[0];
 	startNode.parent = nullptr;
 	startNode.x = x;
 	startNode.y = y;
 	startNode.f = 0;
-	nodeTable[(x << 16) | y] = &startNode;
+	setNodePosition(&startNode);
+
+	openHeap[0] = 0;
+	heapIndex[0] = 0;
+	openCount = 1;
+}
+
+uint16_t* AStarNodes::getGridCell(uint32_t x, uint32_t y)
+{
+	uint32_t gx = x - gridX;
+	uint32_t gy = y - gridY;
+	if (gx >= ASTAR_GRID_SIZE || gy >= ASTAR_GRID_SIZE) {
+		return nullptr;
+	}
+	return &nodeGrid[gx][gy];
+}
+
+void AStarNodes::setNodePosition(AStarNode* node)
+{
+	uint16_t* cell = getGridCell(node->x, node->y);
+	if (cell) {
+		*cell = GET_NODE_INDEX(node) + 1;
+	} else {
+		farNodes[(node->x << 16) | node->y] = node;
+	}
 }
 
 AStarNode* AStarNodes::createOpenNode(AStarNode* parent, uint32_t x, uint32_t y, int_fast32_t f)
@@ -773,36 +1496,35 @@ AStarNode* AStarNodes::createOpenNode(AStarNode* parent, uint32_t x, uint32_t y,
 	}
 
 	size_t retNode = curNode++;
-	openNodes[retNode] = true;
 
 	AStarNode* node = &nodes[retNode];
-	nodeTable[(x << 16) | y] = node;
 	node->parent = parent;
 	node->x = x;
 	node->y = y;
 	node->f = f;
+	setNodePosition(node);
+
+	openHeap[openCount] = retNode;
+	heapIndex[retNode] = openCount;
+	siftUp(openCount++);
 	return node;
 }
 
 AStarNode* AStarNodes::getBestNode()
 {
-	if (curNode == 0) {
+	if (openCount == 0) {
 		return nullptr;
 	}
 
-	int32_t best_node_f = std::numeric_limits<int32_t>::max();
-	int32_t best_node = -1;
-	for (size_t i = 0; i < curNode; i++) {
-		if (openNodes[i] && nodes[i].f < best_node_f) {
-			best_node_f = nodes[i].f;
-			best_node = i;
-		}
-	}
-
-	if (best_node >= 0) {
-		return &nodes[best_node];
+	// the best node leaves the open list right away, it is closed once expanded
+	size_t best_node = openHeap[0];
+	heapIndex[best_node] = -1;
+	if (--openCount != 0) {
+		openHeap[0] = openHeap[openCount];
+		heapIndex[openHeap[0]] = 0;
+		siftDown(0);
 	}
-	return nullptr;
+	return &nodes[best_node];
 }
 
 void AStarNodes::closeNode(AStarNode* node)
@@ -813,7 +1535,6 @@ void AStarNodes::closeNode(AStarNode* node)
 		return;
 	}
 
-	openNodes[pos] = false;
 	++closedNodes;
 }
 
@@ -825,10 +1546,59 @@ void AStarNodes::openNode(AStarNode* node)
 		return;
 	}
 
-	if (!openNodes[pos]) {
-		openNodes[pos] = true;
+	// nodes are only reopened with a lower f
+	if (heapIndex[pos] == -1) {
+		openHeap[openCount] = pos;
+		heapIndex[pos] = openCount;
+		siftUp(openCount++);
 		--closedNodes;
+	} else {
+		siftUp(heapIndex[pos]);
+	}
+}
+
+void AStarNodes::siftUp(size_t heapPos)
+{
+	uint16_t index = openHeap[heapPos];
+	while (heapPos > 0) {
+		size_t parentPos = (heapPos - 1) / 2;
+		uint16_t parentIndex = openHeap[parentPos];
+		if (!isBetterNode(index, parentIndex)) {
+			break;
+		}
+
+		openHeap[heapPos] = parentIndex;
+		heapIndex[parentIndex] = heapPos;
+		heapPos = parentPos;
 	}
+	openHeap[heapPos] = index;
+	heapIndex[index] = heapPos;
+}
+
+void AStarNodes::siftDown(size_t heapPos)
+{
+	uint16_t index = openHeap[heapPos];
+	while (true) {
+		size_t childPos = heapPos * 2 + 1;
+		if (childPos >= openCount) {
+			break;
+		}
+
+		if (childPos + 1 < openCount && isBetterNode(openHeap[childPos + 1], openHeap[childPos])) {
+			++childPos;
+		}
+
+		uint16_t childIndex = openHeap[childPos];
+		if (!isBetterNode(childIndex, index)) {
+			break;
+		}
+
+		openHeap[heapPos] = childIndex;
+		heapIndex[childIndex] = heapPos;
+		heapPos = childPos;
+	}
+	openHeap[heapPos] = index;
+	heapIndex[index] = heapPos;
 }
 
 int_fast32_t AStarNodes::getClosedNodes() const
@@ -838,8 +1608,13 @@ int_fast32_t AStarNodes::getClosedNodes() const
 
 AStarNode* AStarNodes::getNodeByPosition(uint32_t x, uint32_t y)
 {
-	auto it = nodeTable.find((x << 16) | y);
-	if (it == nodeTable.end()) {
+	uint16_t* cell = getGridCell(x, y);
+	if (cell) {
+		return *cell != 0 ? &nodes[*cell - 1] : nullptr;
+	}
+
+	auto it = farNodes.find((x << 16) | y);
+	if (it == farNodes.end()) {
 		return nullptr;
 	}
 	return it->second;
@@ -881,6 +1656,15 @@ Floor::~Floor()
 	}
 }
 
+Chunk::~Chunk()
+{
+	for (uint32_t i = 0; i < CHUNK_SIZE; ++i) {
+		for (uint32_t j = 0; j < CHUNK_SIZE; ++j) {
+			delete tiles[i][j];
+		}
+	}
+}
+
 // QTreeNode
 QTreeNode::QTreeNode()
 {
@@ -935,11 +1719,15 @@ QTreeLeafNode::QTreeLeafNode()
 {
 	for (uint32_t i = 0; i < MAP_MAX_LAYERS; ++i) {
 		m_array[i] = nullptr;
+		creatureCount[i] = 0;
+		playerCount[i] = 0;
 	}
 
 	m_isLeaf = true;
 	m_leafS = nullptr;
 	m_leafE = nullptr;
+	creatureFloors = 0;
+	playerFloors = 0;
 }
 
 QTreeLeafNode::~QTreeLeafNode()
@@ -957,17 +1745,21 @@ Floor* QTreeLeafNode::createFloor(uint32_t z)
 	return m_array[z];
 }
 
-void QTreeLeafNode::addCreature(Creature* c)
+void QTreeLeafNode::addCreature(Creature* c, uint8_t z)
 {
 	creature_list.push_back(c);
 
-	if (c->getPlayer()) {
+	bool isPlayer = c->getPlayer() != nullptr;
+	if (isPlayer) {
 		player_list.push_back(c);
 	}
+	addToFloor(isPlayer, z);
 }
 
-void QTreeLeafNode::removeCreature(Creature* c)
+void QTreeLeafNode::removeCreature(Creature* c, uint8_t z)
 {
+	removeFromFloor(c->getPlayer() != nullptr, z);
+
 	CreatureVector::iterator iter = std::find(creature_list.begin(), creature_list.end(), c);
 	assert(iter != creature_list.end());
 	*iter = creature_list.back();
@@ -981,73 +1773,175 @@ void QTreeLeafNode::removeCreature(Creature* c)
 	}
 }
 
-uint32_t Map::clean() const
+void QTreeLeafNode::moveCreatureFloor(const Creature* c, uint8_t oldZ, uint8_t newZ)
+{
+	bool isPlayer = c->getPlayer() != nullptr;
+	removeFromFloor(isPlayer, oldZ);
+	addToFloor(isPlayer, newZ);
+}
+
+void QTreeLeafNode::addToFloor(bool isPlayer, uint8_t z)
+{
+	if (creatureCount[z]++ == 0) {
+		creatureFloors |= 1 << z;
+	}
+
+	if (isPlayer && playerCount[z]++ == 0) {
+		playerFloors |= 1 << z;
+	}
+}
+
+void QTreeLeafNode::removeFromFloor(bool isPlayer, uint8_t z)
 {
-	uint64_t start = OTSYS_TIME();
-	size_t count = 0, tiles = 0;
+	if (--creatureCount[z] == 0) {
+		creatureFloors &= ~(1 << z);
+	}
+
+	if (isPlayer && --playerCount[z] == 0) {
+		playerFloors &= ~(1 << z);
+	}
+}
+
+std::vector<TileBlock> Map::getTileBlocks() const
+{
+	std::vector<TileBlock> blocks;
+	if (denseStorage) {
+		for (const std::vector<std::unique_ptr<Chunk>>& floorChunks : chunks) {
+			for (const std::unique_ptr<Chunk>& chunk : floorChunks) {
+				if (chunk) {
+					blocks.emplace_back(&chunk->tiles[0][0], CHUNK_SIZE * CHUNK_SIZE);
+				}
+			}
+		}
+	} else {
+		std::vector<const QTreeNode*> nodes {
+			&root
+		};
+		do {
+			const QTreeNode* node = nodes.back();
+			nodes.pop_back();
+			if (node->isLeaf()) {
+				const QTreeLeafNode* leafNode = reinterpret_cast<const QTreeLeafNode*>(node);
+				for (uint8_t z = 0; z < MAP_MAX_LAYERS; ++z) {
+					Floor* floor = leafNode->getFloor(z);
+					if (floor) {
+						blocks.emplace_back(&floor->tiles[0][0], FLOOR_SIZE * FLOOR_SIZE);
+					}
+				}
+			} else {
+				for (size_t i = 0; i < 4; ++i) {
+					QTreeNode* childNode = node->m_child[i];
+					if (childNode) {
+						nodes.push_back(childNode);
+					}
+				}
+			}
+		} while (!nodes.empty());
+	}
+
+	return blocks;
+}
+
+uint32_t Map::clean()
+{
+	if (!cleanItems.empty()) {
+		std::cout << "> CLEAN: Still removing the items of the last clean." << std::endl;
+		return 0;
+	}
+
+	cleanStart = OTSYS_TIME();
 
 	if (g_game.getGameState() == GAME_STATE_NORMAL) {
 		g_game.setGameState(GAME_STATE_MAINTAIN);
 	}
 
-	std::vector<const QTreeNode*> nodes {
-		&root
-	};
-	std::vector<Item*> toRemove;
-	do {
-		const QTreeNode* node = nodes.back();
-		nodes.pop_back();
-		if (node->isLeaf()) {
-			const QTreeLeafNode* leafNode = reinterpret_cast<const QTreeLeafNode*>(node);
-			for (uint8_t z = 0; z < MAP_MAX_LAYERS; ++z) {
-				Floor* floor = leafNode->getFloor(z);
-				if (!floor) {
-					continue;
-				}
+	std::vector<TileBlock> blocks = getTileBlocks();
 
-				for (size_t x = 0; x < FLOOR_SIZE; ++x) {
-					for (size_t y = 0; y < FLOOR_SIZE; ++y) {
-						Tile* tile = floor->tiles[x][y];
-						if (!tile || tile->hasFlag(TILESTATE_PROTECTIONZONE)) {
-							continue;
-						}
+	// the dispatcher waits for the scan, so nothing changes the map meanwhile
+	const size_t threadCount = std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), 8));
+	std::vector<std::vector<Item*>> foundItems(threadCount);
+	std::vector<size_t> foundTiles(threadCount);
 
-						TileItemVector* itemList = tile->getItemList();
-						if (!itemList) {
-							continue;
-						}
+	auto scan = [&](size_t worker) {
+		std::vector<Item*>& items = foundItems[worker];
+		for (size_t block = worker; block < blocks.size(); block += threadCount) {
+			Tile* const* tiles = blocks[block].first;
+			for (size_t i = 0, size = blocks[block].second; i < size; ++i) {
+				const Tile* tile = tiles[i];
+				if (!tile || tile->hasFlag(TILESTATE_PROTECTIONZONE)) {
+					continue;
+				}
 
-						++tiles;
-						for (Item* item : *itemList) {
-							if (item->isCleanable()) {
-								toRemove.push_back(item);
-							}
-						}
+				const TileItemVector* itemList = tile->getItemList();
+				if (!itemList) {
+					continue;
+				}
 
-						for (Item* item : toRemove) {
-							g_game.internalRemoveItem(item, -1);
-						}
-						count += toRemove.size();
-						toRemove.clear();
+				++foundTiles[worker];
+				for (Item* item : *itemList) {
+					if (item->isCleanable()) {
+						items.push_back(item);
 					}
 				}
 			}
-		} else {
-			for (size_t i = 0; i < 4; ++i) {
-				QTreeNode* childNode = node->m_child[i];
-				if (childNode) {
-					nodes.push_back(childNode);
-				}
-			}
 		}
-	} while (!nodes.empty());
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t worker = 1; worker < threadCount; ++worker) {
+		threads.emplace_back(scan, worker);
+	}
+	scan(0);
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	cleanTiles = 0;
+	for (size_t worker = 0; worker < threadCount; ++worker) {
+		cleanTiles += foundTiles[worker];
+		for (Item* item : foundItems[worker]) {
+			item->incrementReferenceCounter();
+			cleanItems.push_back(item);
+		}
+	}
+	cleanPosition = 0;
+	cleanRemoved = 0;
 
 	if (g_game.getGameState() == GAME_STATE_MAINTAIN) {
 		g_game.setGameState(GAME_STATE_NORMAL);
 	}
 
-	std::cout << "> CLEAN: Removed " << count << " item" << (count != 1 ? "s" : "")
-	          << " from " << tiles << " tile" << (tiles != 1 ? "s" : "") << " in "
-	          << (OTSYS_TIME() - start) / (1000.) << " seconds." << std::endl;
+	uint32_t count = cleanItems.size();
+	removeCleanItems();
 	return count;
 }
+
+void Map::removeCleanItems()
+{
+	const int64_t sliceEnd = OTSYS_TIME() + cleanSliceTime;
+	while (cleanPosition < cleanItems.size()) {
+		Item* item = cleanItems[cleanPosition++];
+
+		// players may have picked it up or moved it since the scan
+		Cylinder* parent = item->getParent();
+		if (parent && parent == item->getTile() && !item->isRemoved() && item->isCleanable() && !item->getTile()->hasFlag(TILESTATE_PROTECTIONZONE)) {
+			if (g_game.internalRemoveItem(item, -1) == RETURNVALUE_NOERROR) {
+				++cleanRemoved;
+			}
+		}
+		item->decrementReferenceCounter();
+
+		if ((cleanPosition & 63) == 0 && OTSYS_TIME() >= sliceEnd) {
+			SchedulerTask* task = createSchedulerTask(cleanSliceInterval, std::bind(&Map::removeCleanItems, this), TASK_ORIGIN_MAP_CLEAN);
+			g_scheduler.addEvent(task);
+			return;
+		}
+	}
+
+	cleanItems.clear();
+	cleanItems.shrink_to_fit();
+
+	std::cout << "> CLEAN: Removed " << cleanRemoved << " item" << (cleanRemoved != 1 ? "s" : "")
+	          << " from " << cleanTiles << " tile" << (cleanTiles != 1 ? "s" : "") << " in "
+	          << (OTSYS_TIME() - cleanStart) / (1000.) << " seconds." << std::endl;
+}
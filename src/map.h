@@ -31,6 +31,8 @@
 #include "town.h"
 #include "house.h"
 #include "spawn.h"
+#include "walkability.h"
+#include "pathgraph.h"
 
 class Creature;
 class Player;
@@ -50,13 +52,27 @@ struct AStarNode {
 #define MAX_NODES 512
 #define GET_NODE_INDEX(a) (a - &nodes[0])
 
+// side of the square around the start position in which nodes are found
+// through a flat grid, nodes further away fall back to a hash table
+#define ASTAR_GRID_BITS 7
+#define ASTAR_GRID_SIZE (1 << ASTAR_GRID_BITS)
+
 #define MAP_NORMALWALKCOST 10
 #define MAP_DIAGONALWALKCOST 25
 
+// Node arena of one path search, reused by every search of a thread.
+// Open nodes are kept in an indexed binary heap ordered by f.
 class AStarNodes
 {
 	public:
-		AStarNodes(uint32_t x, uint32_t y);
+		AStarNodes();
+
+		// non-copyable
+		AStarNodes(const AStarNodes&) = delete;
+		AStarNodes& operator=(const AStarNodes&) = delete;
+
+		// forgets the previous search and starts a new one at x, y
+		void reset(uint32_t x, uint32_t y);
 
 		AStarNode* createOpenNode(AStarNode* parent, uint32_t x, uint32_t y, int_fast32_t f);
 		AStarNode* getBestNode();
@@ -69,19 +85,87 @@ class AStarNodes
 		static int_fast32_t getTileWalkCost(const Creature& creature, const Tile* tile);
 
 	private:
+		uint16_t* getGridCell(uint32_t x, uint32_t y);
+		void setNodePosition(AStarNode* node);
+		// lower f first, ties go to the older node
+		bool isBetterNode(uint16_t lhs, uint16_t rhs) const {
+			return nodes[lhs].f < nodes[rhs].f || (nodes[lhs].f == nodes[rhs].f && lhs < rhs);
+		}
+		void siftUp(size_t heapPos);
+		void siftDown(size_t heapPos);
+
 		AStarNode nodes[MAX_NODES];
-		bool openNodes[MAX_NODES];
-		std::unordered_map<uint32_t, AStarNode*> nodeTable;
+		int_fast32_t heapIndex[MAX_NODES]; // position in openHeap, -1 while closed
+		uint16_t openHeap[MAX_NODES];
+		size_t openCount;
+
+		uint16_t nodeGrid[ASTAR_GRID_SIZE][ASTAR_GRID_SIZE]; // node index + 1, 0 if none
+		std::unordered_map<uint32_t, AStarNode*> farNodes;
+		uint32_t gridX, gridY;
+
 		size_t curNode;
 		int_fast32_t closedNodes;
 };
 
-typedef std::map<Position, std::shared_ptr<SpectatorVec>> SpectatorCache;
+#define FLOW_FIELD_RADIUS 14
+#define FLOW_FIELD_SIZE (FLOW_FIELD_RADIUS * 2 + 1)
+#define FLOW_FIELD_UNREACHABLE 0xFFFF
+
+// Walk cost from every tile around a chased creature to the tiles next to it,
+// searched once backwards from the target and shared by every follower of the
+// same path class. Only the walkability flags are taken into account, the
+// followers still check their own steps.
+struct FlowField {
+	Position center;
+	int64_t lastUsed;
+	PathClass_t pathClass;
+	bool valid;
+	uint16_t cost[FLOW_FIELD_SIZE][FLOW_FIELD_SIZE]; // [y][x], relative to center
+};
+
+// keyed by target id << 8 | path class
+typedef std::unordered_map<uint64_t, FlowField> FlowFieldCache;
+
+// keys of the flow fields centered in a walkability chunk,
+// keyed by (x >> WALKABILITY_CHUNK_BITS) << 16 | (y >> WALKABILITY_CHUNK_BITS)
+typedef std::unordered_map<uint32_t, std::vector<uint64_t>> FlowFieldIndex;
+
+#define SIGHT_CACHE_BITS 12
+#define SIGHT_CACHE_SIZE (1 << SIGHT_CACHE_BITS)
+
+// Result of a same floor sight check between two positions, only valid
+// while no projectile blocker changed in the walkability chunks covered by
+// the rectangle between them since it was computed.
+struct SightCacheEntry {
+	uint64_t key; // lower position first, x << 48 | y << 32 | x << 16 | y
+	uint32_t generation;
+	uint8_t z;
+	bool clear;
+};
 
 #define FLOOR_BITS 3
 #define FLOOR_SIZE (1 << FLOOR_BITS)
 #define FLOOR_MASK (FLOOR_SIZE - 1)
 
+// Every creature that a default range getSpectators call centered anywhere
+// inside one FLOOR_SIZE x FLOOR_SIZE sector of floor z can see. Callers
+// filter it down to their exact center.
+struct SpectatorCacheEntry {
+	SpectatorCacheEntry(uint8_t z, bool multifloor, bool onlyPlayers) :
+		z(z), multifloor(multifloor), onlyPlayers(onlyPlayers), valid(false) {}
+
+	std::vector<Creature*> creatures;
+	uint8_t z;
+	uint8_t minRangeZ;
+	uint8_t maxRangeZ;
+	bool multifloor;
+	bool onlyPlayers;
+	bool valid;
+};
+
+// keyed by sector, (x >> FLOOR_BITS) << 16 | (y >> FLOOR_BITS)
+typedef std::unordered_map<uint32_t, std::vector<SpectatorCacheEntry>> SpectatorCache;
+
 struct Floor {
 	Floor() : tiles() {}
 	~Floor();
@@ -93,7 +177,27 @@ struct Floor {
 	Tile* tiles[FLOOR_SIZE][FLOOR_SIZE];
 };
 
+#define CHUNK_BITS 5
+#define CHUNK_SIZE (1 << CHUNK_BITS)
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+
+// Block of tiles of the dense tile storage, owns its tiles like Floor does
+struct Chunk {
+	Chunk() : tiles() {}
+	~Chunk();
+
+	// non-copyable
+	Chunk(const Chunk&) = delete;
+	Chunk& operator=(const Chunk&) = delete;
+
+	Tile* tiles[CHUNK_SIZE][CHUNK_SIZE];
+};
+
+// a floor of a quadtree leaf or a chunk, as its first tile and tile count
+typedef std::pair<Tile* const*, size_t> TileBlock;
+
 class FrozenPathingConditionCall;
+class PathSnapshot;
 class QTreeLeafNode;
 
 class QTreeNode
@@ -152,10 +256,14 @@ class QTreeLeafNode final : public QTreeNode
 			return m_array[z];
 		}
 
-		void addCreature(Creature* c);
-		void removeCreature(Creature* c);
+		void addCreature(Creature* c, uint8_t z);
+		void removeCreature(Creature* c, uint8_t z);
+		void moveCreatureFloor(const Creature* c, uint8_t oldZ, uint8_t newZ);
 
 	protected:
+		void addToFloor(bool isPlayer, uint8_t z);
+		void removeFromFloor(bool isPlayer, uint8_t z);
+
 		static bool newLeaf;
 		QTreeLeafNode* m_leafS;
 		QTreeLeafNode* m_leafE;
@@ -163,6 +271,13 @@ class QTreeLeafNode final : public QTreeNode
 		CreatureVector creature_list;
 		CreatureVector player_list;
 
+		// per floor index of the lists above, bit z of the masks is set
+		// while floor z holds at least one creature/player
+		uint16_t creatureCount[MAP_MAX_LAYERS];
+		uint16_t playerCount[MAP_MAX_LAYERS];
+		uint16_t creatureFloors;
+		uint16_t playerFloors;
+
 		friend class Map;
 		friend class QTreeNode;
 };
@@ -175,14 +290,23 @@ class QTreeLeafNode final : public QTreeNode
 class Map
 {
 	public:
-		Map() : width(0), height(0) {}
+		Map() : sightCache(), sightGeneration(1), chunksX(0), chunksY(0), denseStorage(false), width(0), height(0) {}
 
 		static const int32_t maxViewportX = 11; //min value: maxClientViewportX + 1
 		static const int32_t maxViewportY = 11; //min value: maxClientViewportY + 1
 		static const int32_t maxClientViewportX = 8;
 		static const int32_t maxClientViewportY = 6;
 
-		uint32_t clean() const;
+		static const size_t maxSpectatorCacheSectors = 16384;
+		static const size_t maxFlowFields = 1024;
+
+		/**
+		  * Collects every cleanable item of the map on worker threads and
+		  * removes them in short slices over the next dispatcher cycles.
+		  * \returns the number of items queued for removal, items that were
+		  * picked up or moved into a protection zone meanwhile are skipped
+		  */
+		uint32_t clean();
 
 		/**
 		  * Load a map.
@@ -235,7 +359,14 @@ class Map
 		                   int32_t minRangeY = 0, int32_t maxRangeY = 0);
 
 		void clearSpectatorCache();
-		
+
+		/**
+		  * Invalidates the cached spectators that see a creature appear, move or disappear.
+		  * \param oldPos The position the creature left, nullptr if it was placed
+		  * \param newPos The position the creature entered, nullptr if it was removed
+		  */
+		void updateSpectatorCache(const Creature& creature, const Position* oldPos, const Position* newPos);
+
 		/**
 		  * Checks if you can throw an object to that position
 		  *	\param fromPos from Source point
@@ -261,8 +392,50 @@ class Map
 
 		const Tile* canWalkTo(const Creature& creature, const Position& pos) const;
 
+		/**
+		  * Reads the packed walkability flags of a position, see WalkabilityFlags_t.
+		  * \returns WALKABILITY_NONE if there is no tile
+		  */
+		uint16_t getWalkability(uint16_t x, uint16_t y, uint8_t z) const;
+
+		/**
+		  * Re-reads the walkability flags of a tile after its items changed,
+		  * the path graph, flow fields and sight checks are only told about
+		  * it if the flags are different.
+		  */
+		void updateWalkability(const Tile* tile);
+
+		/**
+		  * Checks the walkability flags for anything that keeps a creature
+		  * from pathing onto a position, regardless of who stands there.
+		  * Tiles that pass still need Tile::queryAdd.
+		  */
+		bool isPathBlocked(const Creature& creature, const Position& pos) const;
+		static bool isPathBlocked(uint16_t flags, PathClass_t pathClass);
+		static PathClass_t getPathClass(const Creature& creature);
+
+		/**
+		  * Finds the path of a melee chase through the shared flow field of the target.
+		  * \returns false if the field can not answer it and getPathMatching has to
+		  */
+		bool getFollowPath(const Creature& creature, const Creature& target, std::forward_list<Direction>& dirList,
+		                   const FindPathParams& fpp) const;
+
 		bool getPathMatching(const Creature& creature, std::forward_list<Direction>& dirList,
 		                     const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const;
+		bool getPathMatching(const Creature& creature, const Position& startPos, std::forward_list<Direction>& dirList,
+		                     const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp) const;
+		// searches a snapshot instead of the map, safe to call from any thread
+		static bool getPathMatching(const PathSnapshot& snapshot, std::forward_list<Direction>& dirList,
+		                            const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp);
+
+		/**
+		  * Finds an unbounded path that leaves the start cluster through the portals
+		  * of the path graph, refining every leg with getPathMatching.
+		  * \returns false if the target is too close for it or the graph has no path
+		  */
+		bool getLongPath(const Creature& creature, const Position& targetPos, std::forward_list<Direction>& dirList,
+		                 const FindPathParams& fpp) const;
 
 		std::map<std::string, Position> waypoints;
 
@@ -275,23 +448,63 @@ class Map
 		Houses houses;
 	protected:
 		SpectatorCache spectatorCache;
-		SpectatorCache playersSpectatorCache;
 
 		QTreeNode root;
 
+		mutable WalkabilityMap walkability;
+		mutable FlowFieldCache flowFields;
+		mutable FlowFieldIndex flowFieldIndex;
+		mutable PathGraph pathGraph;
+
+		mutable SightCacheEntry sightCache[SIGHT_CACHE_SIZE];
+		uint32_t sightGeneration; // stamped on chunks and sight cache entries
+
+		// dense tile storage, chunks[z][chunkY * chunksX + chunkX]
+		// the quadtree leaves still hold the creature lists, but no floors
+		std::vector<std::unique_ptr<Chunk>> chunks[MAP_MAX_LAYERS];
+		uint32_t chunksX, chunksY;
+		bool denseStorage;
+
+		// items of the running clean, each holds a reference until it is removed
+		std::vector<Item*> cleanItems;
+		size_t cleanPosition = 0;
+		size_t cleanTiles = 0;
+		size_t cleanRemoved = 0;
+		uint64_t cleanStart = 0;
+
+		static const int64_t cleanSliceTime = 5;
+		static const uint32_t cleanSliceInterval = 10;
+
 		std::string spawnfile;
 		std::string housefile;
 
 		uint32_t width, height;
 
 		// Actually scans the map for spectators
-		void getSpectatorsInternal(SpectatorVec& list, const Position& centerPos,
+		template <typename Container>
+		void getSpectatorsInternal(Container& list, const Position& centerPos,
 		                           int32_t minRangeX, int32_t maxRangeX,
 		                           int32_t minRangeY, int32_t maxRangeY,
 		                           int32_t minRangeZ, int32_t maxRangeZ, bool onlyPlayers) const;
 
+		const std::vector<Creature*>& getSpectatorCandidates(const Position& centerPos, bool multifloor, bool onlyPlayers,
+		                                                     int32_t minRangeZ, int32_t maxRangeZ);
+		void invalidateSpectatorSectors(const int32_t (&sectors)[4], bool isPlayer, const Position* oldPos, const Position* newPos);
+
+		Chunk* createChunk(uint16_t x, uint16_t y, uint8_t z);
+
+		std::vector<TileBlock> getTileBlocks() const;
+		void removeCleanItems();
+
+		const FlowField* getFlowField(const Creature& target, PathClass_t pathClass) const;
+		void buildFlowField(FlowField& field) const;
+		void invalidateFlowFields(const Position& pos);
+		void indexFlowField(uint64_t key, const Position& center) const;
+		void unindexFlowField(uint64_t key, const Position& center) const;
+
 		friend class Game;
 		friend class IOMap;
+		friend class WorldCache;
 };
 
 #endif
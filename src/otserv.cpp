@@ -44,10 +44,14 @@
 #include "databasemanager.h"
 #include "scheduler.h"
 #include "databasetasks.h"
+#include "taskstats.h"
+#include "pathfinder.h"
 
 DatabaseTasks g_databaseTasks;
 Dispatcher g_dispatcher;
 Scheduler g_scheduler;
+TaskStats g_taskStats;
+Pathfinder g_pathfinder;
 
 IPList serverIPs;
 
@@ -132,6 +136,7 @@ int main(int argc, char* argv[])
 
 	g_scheduler.join();
 	g_databaseTasks.join();
+	g_pathfinder.join();
 	g_dispatcher.join();
 	return 0;
 }
@@ -275,6 +280,13 @@ void mainLoader(int, char*[], ServiceManager* services)
 	std::cout << ">> Initializing gamestate" << std::endl;
 	g_game.setGameState(GAME_STATE_INIT);
 
+	int32_t networkThreads = g_config.getNumber(ConfigManager::NETWORK_THREADS);
+	if (networkThreads <= 0) {
+		networkThreads = std::max<int32_t>(1, std::thread::hardware_concurrency());
+	}
+	std::cout << ">> Handling connections on " << networkThreads << " network threads" << std::endl;
+	services->setNetworkThreads(networkThreads);
+
 	// Game client protocols
 	services->add<ProtocolGame>(g_config.getNumber(ConfigManager::GAME_PORT));
 	services->add<ProtocolLogin>(g_config.getNumber(ConfigManager::LOGIN_PORT));
@@ -347,6 +359,20 @@ void mainLoader(int, char*[], ServiceManager* services)
 	}
 #endif
 
+	int32_t tickInterval = g_config.getNumber(ConfigManager::GAME_TICK_INTERVAL);
+	if (tickInterval > 0) {
+		std::cout << ">> Running the game loop in " << tickInterval << " ms ticks" << std::endl;
+		g_dispatcher.setTickInterval(tickInterval);
+	}
+
+	g_taskStats.startLogging(g_config.getNumber(ConfigManager::TASK_STATS_LOG_INTERVAL));
+
+	int32_t pathfinderThreads = g_config.getNumber(ConfigManager::PATHFINDER_THREADS);
+	if (pathfinderThreads > 0) {
+		std::cout << ">> Searching monster paths on " << pathfinderThreads << " threads" << std::endl;
+		g_pathfinder.start(pathfinderThreads);
+	}
+
 	g_game.start(services);
 	g_game.setGameState(GAME_STATE_NORMAL);
 	g_loaderSignal.notify_all();
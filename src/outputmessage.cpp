@@ -23,18 +23,31 @@
 #include "protocol.h"
 #include "scheduler.h"
 
-OutputMessage::OutputMessage()
+typedef LockfreeObjectPool<OutputMessage, OUTPUT_POOL_THREAD_CACHE, OUTPUT_POOL_CAPACITY> OutputMessageFreeList;
+
+OutputMessage::OutputMessage() : refCount(0)
 {
 	freeMessage();
 }
 
+void intrusive_ptr_add_ref(OutputMessage* msg)
+{
+	msg->refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void intrusive_ptr_release(OutputMessage* msg)
+{
+	if (msg->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		OutputMessagePool::getInstance()->releaseMessage(msg);
+	}
+}
+
 // OutputMessagePool
 
 OutputMessagePool::OutputMessagePool()
 {
 	for (uint32_t i = 0; i < OUTPUT_POOL_SIZE; ++i) {
-		OutputMessage* msg = new OutputMessage();
-		outputMessages.push_back(msg);
+		OutputMessageFreeList::release(new OutputMessage());
 	}
 
 	frameTime = OTSYS_TIME();
@@ -43,67 +56,41 @@ OutputMessagePool::OutputMessagePool()
 
 void OutputMessagePool::startExecutionFrame()
 {
-	//std::lock_guard<std::recursive_mutex> lockClass(outputPoolLock);
 	frameTime = OTSYS_TIME();
 }
 
-OutputMessagePool::~OutputMessagePool()
-{
-	for (OutputMessage* msg : outputMessages) {
-		delete msg;
-	}
-}
-
 void OutputMessagePool::send(OutputMessage_ptr msg)
 {
-	outputPoolLock.lock();
-	OutputMessage::OutputMessageState state = msg->getState();
-	outputPoolLock.unlock();
-
-	if (state == OutputMessage::STATE_ALLOCATED_NO_AUTOSEND) {
+	if (msg->getState() == OutputMessage::STATE_ALLOCATED_NO_AUTOSEND) {
 		Connection_ptr connection = msg->getConnection();
 		if (connection && !connection->send(msg)) {
 			// Send only fails when connection is closing (or in error state)
-			// This call will free the message
+			// The protocol drops its buffer reference, the message goes back
+			// to the pool once the last reference to it is released
 			msg->getProtocol()->onSendMessage(msg);
 		}
 	}
 }
 
-void OutputMessagePool::sendAll()
+void OutputMessagePool::sendAll(bool flush /*= false*/)
 {
-	std::lock_guard<std::recursive_mutex> lockClass(outputPoolLock);
-
-	const int64_t dropTime = frameTime - 10000;
 	const int64_t staleTime = frameTime - 10;
 
-	for (OutputMessage_ptr msg : toAddQueue) {
-		const int64_t msgFrame = msg->getFrame();
-		if (msgFrame >= dropTime) {
-			msg->setState(OutputMessage::STATE_ALLOCATED);
-
-			if (msgFrame < staleTime) {
-				autoSendOutputMessages.push_front(msg);
-			} else {
-				autoSendOutputMessages.push_back(msg);
-			}
-		} else {
-			//drop messages that are older than 10 seconds
-			msg->getProtocol()->onSendMessage(msg);
-		}
-	}
-	toAddQueue.clear();
+	while (!autoSendOutputMessages.empty()) {
+		OutputMessage_ptr msg = autoSendOutputMessages.front();
 
-	for (auto it = autoSendOutputMessages.begin(), end = autoSendOutputMessages.end(); it != end; it = autoSendOutputMessages.erase(it)) {
-		OutputMessage_ptr msg = *it;
-		if (staleTime <= msg->getFrame()) {
+		// flush sends the messages of the current frame as well
+		if (!flush && staleTime <= msg->getFrame()) {
 			break;
 		}
 
+		autoSendOutputMessages.pop_front();
+
 		Connection_ptr connection = msg->getConnection();
 		if (connection && !connection->send(msg)) {
 			// Send only fails when connection is closing (or in error state)
-			// This call will free the message
+			// The protocol drops its buffer reference, the message goes back
+			// to the pool once the last reference to it is released
 			msg->getProtocol()->onSendMessage(msg);
 		}
 	}
@@ -111,12 +98,7 @@ void OutputMessagePool::sendAll()
 
 void OutputMessagePool::releaseMessage(OutputMessage* msg)
 {
-	g_dispatcher.addTask(
-	    createTask(std::bind(&OutputMessagePool::internalReleaseMessage, this, msg)));
-}
-
-void OutputMessagePool::internalReleaseMessage(OutputMessage* msg)
-{
+	// runs on whichever thread dropped the last reference
 	if (msg->getProtocol()) {
 		msg->getProtocol()->unRef();
 	} else {
@@ -130,10 +112,7 @@ void OutputMessagePool::internalReleaseMessage(OutputMessage* msg)
 	}
 
 	msg->freeMessage();
-
-	outputPoolLock.lock();
-	outputMessages.push_back(msg);
-	outputPoolLock.unlock();
+	OutputMessageFreeList::release(msg);
 }
 
 OutputMessage_ptr OutputMessagePool::getOutputMessage(Protocol* protocol, bool autosend /*= true*/)
@@ -142,23 +121,16 @@ OutputMessage_ptr OutputMessagePool::getOutputMessage(Protocol* protocol, bool a
 		return OutputMessage_ptr();
 	}
 
-	std::lock_guard<std::recursive_mutex> lockClass(outputPoolLock);
-
 	if (!protocol->getConnection()) {
 		return OutputMessage_ptr();
 	}
 
-	if (outputMessages.empty()) {
-		OutputMessage* msg = new OutputMessage();
-		outputMessages.push_back(msg);
+	OutputMessage* msg = OutputMessageFreeList::acquire();
+	if (!msg) {
+		msg = new OutputMessage();
 	}
 
-	OutputMessage_ptr outputmessage;
-	outputmessage.reset(outputMessages.back(),
-	                    std::bind(&OutputMessagePool::releaseMessage, this, std::placeholders::_1));
-
-	outputMessages.pop_back();
-
+	OutputMessage_ptr outputmessage(msg);
 	configureOutputMessage(outputmessage, protocol, autosend);
 	return outputmessage;
 }
@@ -185,10 +157,3 @@ void OutputMessagePool::configureOutputMessage(OutputMessage_ptr msg, Protocol*
 
 	msg->setFrame(frameTime);
 }
-
-void OutputMessagePool::addToAutoSend(OutputMessage_ptr msg)
-{
-	outputPoolLock.lock();
-	toAddQueue.push_back(msg);
-	outputPoolLock.unlock();
-}
@@ -20,13 +20,18 @@
 #ifndef FS_OUTPUTMESSAGE_H_C06AAED85C7A43939F22D229297C0CC1
 #define FS_OUTPUTMESSAGE_H_C06AAED85C7A43939F22D229297C0CC1
 
+#include <deque>
+
 #include "networkmessage.h"
 #include "connection.h"
+#include "lockfree.h"
 #include "tools.h"
 
 class Protocol;
 
 #define OUTPUT_POOL_SIZE 100
+#define OUTPUT_POOL_THREAD_CACHE 16
+#define OUTPUT_POOL_CAPACITY 1024
 
 class OutputMessage : public NetworkMessage
 {
@@ -89,6 +94,13 @@ class OutputMessage : public NetworkMessage
 			frame = new_frame;
 		}
 
+		void setEncoding(bool raw, bool encryption, bool checksum, const uint32_t* key) {
+			rawMessage = raw;
+			encryptionEnabled = encryption;
+			checksumEnabled = checksum;
+			memcpy(xteaKey, key, sizeof(xteaKey));
+		}
+
 	protected:
 		template <typename T>
 		inline void add_header(T add) {
@@ -108,6 +120,9 @@ class OutputMessage : public NetworkMessage
 			setConnection(Connection_ptr());
 			setProtocol(nullptr);
 			frame = 0;
+			rawMessage = false;
+			encryptionEnabled = false;
+			checksumEnabled = false;
 
 			// Allocate enough size for headers:
 			// 2 bytes for unencrypted message size
@@ -120,6 +135,9 @@ class OutputMessage : public NetworkMessage
 		}
 
 		friend class OutputMessagePool;
+		friend class Protocol;
+		friend void intrusive_ptr_add_ref(OutputMessage* msg);
+		friend void intrusive_ptr_release(OutputMessage* msg);
 
 		void setProtocol(Protocol* protocol) {
 			m_protocol = protocol;
@@ -138,9 +156,17 @@ class OutputMessage : public NetworkMessage
 		Connection_ptr connection;
 		Protocol* m_protocol;
 
+		std::atomic<uint32_t> refCount;
+
 		int64_t frame;
 		uint32_t outputBufferStart;
 
+		// protocol settings at the time the message was sent
+		uint32_t xteaKey[4];
+		bool rawMessage;
+		bool encryptionEnabled;
+		bool checksumEnabled;
+
 		OutputMessageState state;
 };
 
@@ -150,8 +176,6 @@ class OutputMessagePool
 		OutputMessagePool();
 
 	public:
-		~OutputMessagePool();
-
 		// non-copyable
 		OutputMessagePool(const OutputMessagePool&) = delete;
 		OutputMessagePool& operator=(const OutputMessagePool&) = delete;
@@ -162,7 +186,7 @@ class OutputMessagePool
 		}
 
 		void send(OutputMessage_ptr msg);
-		void sendAll();
+		void sendAll(bool flush = false);
 		void stop() {
 			m_open = false;
 		}
@@ -173,21 +197,14 @@ class OutputMessagePool
 			return frameTime;
 		}
 
-		void addToAutoSend(OutputMessage_ptr msg);
-
 	protected:
 		void configureOutputMessage(OutputMessage_ptr msg, Protocol* protocol, bool autosend);
 		void releaseMessage(OutputMessage* msg);
-		void internalReleaseMessage(OutputMessage* msg);
 
-		typedef std::list<OutputMessage*> InternalOutputMessageList;
-		typedef std::list<OutputMessage_ptr> OutputMessageMessageList;
+		friend void intrusive_ptr_release(OutputMessage* msg);
 
-		InternalOutputMessageList outputMessages;
-		InternalOutputMessageList allOutputMessages;
-		OutputMessageMessageList autoSendOutputMessages;
-		OutputMessageMessageList toAddQueue;
-		std::recursive_mutex outputPoolLock;
+		// only touched by the dispatcher, messages are released on any thread
+		std::deque<OutputMessage_ptr> autoSendOutputMessages;
 		int64_t frameTime;
 		bool m_open;
 };
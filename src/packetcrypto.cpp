@@ -0,0 +1,496 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include "packetcrypto.h"
+#include "tools.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PACKETCRYPTO_SSE2
+#endif
+#if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#define PACKETCRYPTO_AVX2
+#endif
+#endif
+
+#ifdef PACKETCRYPTO_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef PACKETCRYPTO_AVX2
+#include <immintrin.h>
+#ifdef __GNUC__
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#include <intrin.h>
+#define AVX2_TARGET
+#endif
+#endif
+
+static const uint32_t XTEA_DELTA = 0x61C88647;
+static const uint32_t XTEA_ROUNDS = 32;
+
+const uint32_t ADLER_BASE = 65521;
+// largest n such that 255n(n+1)/2 + (n+1)(BASE-1) fits in 32 bits
+static const size_t ADLER_NMAX = 5552;
+
+// The key schedule does not depend on the data, so it is worked out once
+// per call and every block (or SIMD lane) shares it.
+struct XTEASchedule
+{
+	uint32_t first[XTEA_ROUNDS];
+	uint32_t second[XTEA_ROUNDS];
+};
+
+static void getEncryptSchedule(const uint32_t* key, XTEASchedule& schedule)
+{
+	uint32_t sum = 0;
+	for (uint32_t i = 0; i < XTEA_ROUNDS; ++i) {
+		schedule.first[i] = sum + key[sum & 3];
+		sum -= XTEA_DELTA;
+		schedule.second[i] = sum + key[(sum >> 11) & 3];
+	}
+}
+
+static void getDecryptSchedule(const uint32_t* key, XTEASchedule& schedule)
+{
+	uint32_t sum = 0xC6EF3720;
+	for (uint32_t i = 0; i < XTEA_ROUNDS; ++i) {
+		schedule.first[i] = sum + key[(sum >> 11) & 3];
+		sum += XTEA_DELTA;
+		schedule.second[i] = sum + key[sum & 3];
+	}
+}
+
+static void xteaEncryptBlocks(uint32_t* buffer, size_t blocks, const XTEASchedule& schedule)
+{
+	for (size_t i = 0; i < blocks; ++i) {
+		uint32_t v0 = buffer[2 * i], v1 = buffer[2 * i + 1];
+		for (uint32_t round = 0; round < XTEA_ROUNDS; ++round) {
+			v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ schedule.first[round];
+			v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ schedule.second[round];
+		}
+		buffer[2 * i] = v0;
+		buffer[2 * i + 1] = v1;
+	}
+}
+
+static void xteaDecryptBlocks(uint32_t* buffer, size_t blocks, const XTEASchedule& schedule)
+{
+	for (size_t i = 0; i < blocks; ++i) {
+		uint32_t v0 = buffer[2 * i], v1 = buffer[2 * i + 1];
+		for (uint32_t round = 0; round < XTEA_ROUNDS; ++round) {
+			v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ schedule.first[round];
+			v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ schedule.second[round];
+		}
+		buffer[2 * i] = v0;
+		buffer[2 * i + 1] = v1;
+	}
+}
+
+// scalar
+
+static void xteaEncryptScalar(uint8_t* data, size_t length, const uint32_t* key)
+{
+	XTEASchedule schedule;
+	getEncryptSchedule(key, schedule);
+	xteaEncryptBlocks(reinterpret_cast<uint32_t*>(data), length / 8, schedule);
+}
+
+static void xteaDecryptScalar(uint8_t* data, size_t length, const uint32_t* key)
+{
+	XTEASchedule schedule;
+	getDecryptSchedule(key, schedule);
+	xteaDecryptBlocks(reinterpret_cast<uint32_t*>(data), length / 8, schedule);
+}
+
+static uint32_t adler32Scalar(const uint8_t* data, size_t length)
+{
+	uint32_t a = 1, b = 0;
+	while (length > 0) {
+		size_t chunk = std::min(length, ADLER_NMAX);
+		length -= chunk;
+
+		do {
+			a += *data++;
+			b += a;
+		} while (--chunk);
+
+		a %= ADLER_BASE;
+		b %= ADLER_BASE;
+	}
+	return (b << 16) | a;
+}
+
+#ifdef PACKETCRYPTO_SSE2
+
+// Four blocks per iteration: the v0 and v1 halves of the blocks are
+// gathered into one register each, run through the rounds together and
+// interleaved back.
+
+static inline void xteaLoad4(const uint8_t* data, __m128i& v0, __m128i& v1)
+{
+	__m128i a = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), _MM_SHUFFLE(3, 1, 2, 0));
+	__m128i b = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)), _MM_SHUFFLE(3, 1, 2, 0));
+	v0 = _mm_unpacklo_epi64(a, b);
+	v1 = _mm_unpackhi_epi64(a, b);
+}
+
+static inline void xteaStore4(uint8_t* data, __m128i v0, __m128i v1)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(data), _mm_shuffle_epi32(_mm_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(data + 16), _mm_shuffle_epi32(_mm_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+static inline __m128i xteaMix(__m128i v, __m128i schedule)
+{
+	__m128i mixed = _mm_xor_si128(_mm_slli_epi32(v, 4), _mm_srli_epi32(v, 5));
+	return _mm_xor_si128(_mm_add_epi32(mixed, v), schedule);
+}
+
+static void xteaEncryptSSE2(uint8_t* data, size_t length, const uint32_t* key)
+{
+	XTEASchedule schedule;
+	getEncryptSchedule(key, schedule);
+
+	size_t blocks = length / 8;
+	for (; blocks >= 4; blocks -= 4, data += 32) {
+		__m128i v0, v1;
+		xteaLoad4(data, v0, v1);
+		for (uint32_t round = 0; round < XTEA_ROUNDS; ++round) {
+			v0 = _mm_add_epi32(v0, xteaMix(v1, _mm_set1_epi32(schedule.first[round])));
+			v1 = _mm_add_epi32(v1, xteaMix(v0, _mm_set1_epi32(schedule.second[round])));
+		}
+		xteaStore4(data, v0, v1);
+	}
+	xteaEncryptBlocks(reinterpret_cast<uint32_t*>(data), blocks, schedule);
+}
+
+static void xteaDecryptSSE2(uint8_t* data, size_t length, const uint32_t* key)
+{
+	XTEASchedule schedule;
+	getDecryptSchedule(key, schedule);
+
+	size_t blocks = length / 8;
+	for (; blocks >= 4; blocks -= 4, data += 32) {
+		__m128i v0, v1;
+		xteaLoad4(data, v0, v1);
+		for (uint32_t round = 0; round < XTEA_ROUNDS; ++round) {
+			v1 = _mm_sub_epi32(v1, xteaMix(v0, _mm_set1_epi32(schedule.first[round])));
+			v0 = _mm_sub_epi32(v0, xteaMix(v1, _mm_set1_epi32(schedule.second[round])));
+		}
+		xteaStore4(data, v0, v1);
+	}
+	xteaDecryptBlocks(reinterpret_cast<uint32_t*>(data), blocks, schedule);
+}
+
+static inline uint32_t horizontalSum(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+}
+
+// For a block of n bytes, b grows by n * a plus the bytes weighted n..1,
+// and a by their plain sum. The blocks of a chunk are summed up in vector
+// lanes and folded into a and b before the modulo.
+static uint32_t adler32SSE2(const uint8_t* data, size_t length)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weightsLow = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+	const __m128i weightsHigh = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+
+	uint32_t a = 1, b = 0;
+	while (length > 0) {
+		size_t chunk = std::min(length, ADLER_NMAX);
+		length -= chunk;
+
+		size_t blocks = chunk / 16;
+		chunk -= blocks * 16;
+
+		__m128i sumA = zero, sumPrefix = zero, sumB = zero;
+		b += a * static_cast<uint32_t>(blocks * 16);
+		for (size_t i = 0; i < blocks; ++i, data += 16) {
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			sumPrefix = _mm_add_epi32(sumPrefix, sumA);
+			sumA = _mm_add_epi32(sumA, _mm_sad_epu8(bytes, zero));
+			sumB = _mm_add_epi32(sumB, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weightsLow));
+			sumB = _mm_add_epi32(sumB, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weightsHigh));
+		}
+		b += 16 * horizontalSum(sumPrefix) + horizontalSum(sumB);
+		a += horizontalSum(sumA);
+
+		while (chunk-- > 0) {
+			a += *data++;
+			b += a;
+		}
+
+		a %= ADLER_BASE;
+		b %= ADLER_BASE;
+	}
+	return (b << 16) | a;
+}
+
+#endif
+
+#ifdef PACKETCRYPTO_AVX2
+
+// Same layout as the SSE2 version with eight blocks per iteration. The
+// shuffles work within 128-bit lanes, which only changes the order of the
+// blocks inside the registers and is undone by the store.
+
+static AVX2_TARGET inline void xteaLoad8(const uint8_t* data, __m256i& v0, __m256i& v1)
+{
+	__m256i a = _mm256_shuffle_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)), _MM_SHUFFLE(3, 1, 2, 0));
+	__m256i b = _mm256_shuffle_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32)), _MM_SHUFFLE(3, 1, 2, 0));
+	v0 = _mm256_unpacklo_epi64(a, b);
+	v1 = _mm256_unpackhi_epi64(a, b);
+}
+
+static AVX2_TARGET inline void xteaStore8(uint8_t* data, __m256i v0, __m256i v1)
+{
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(data), _mm256_shuffle_epi32(_mm256_unpacklo_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(data + 32), _mm256_shuffle_epi32(_mm256_unpackhi_epi64(v0, v1), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+static AVX2_TARGET inline __m256i xteaMix(__m256i v, __m256i schedule)
+{
+	__m256i mixed = _mm256_xor_si256(_mm256_slli_epi32(v, 4), _mm256_srli_epi32(v, 5));
+	return _mm256_xor_si256(_mm256_add_epi32(mixed, v), schedule);
+}
+
+static AVX2_TARGET void xteaEncryptAVX2(uint8_t* data, size_t length, const uint32_t* key)
+{
+	XTEASchedule schedule;
+	getEncryptSchedule(key, schedule);
+
+	size_t blocks = length / 8;
+	for (; blocks >= 8; blocks -= 8, data += 64) {
+		__m256i v0, v1;
+		xteaLoad8(data, v0, v1);
+		for (uint32_t round = 0; round < XTEA_ROUNDS; ++round) {
+			v0 = _mm256_add_epi32(v0, xteaMix(v1, _mm256_set1_epi32(schedule.first[round])));
+			v1 = _mm256_add_epi32(v1, xteaMix(v0, _mm256_set1_epi32(schedule.second[round])));
+		}
+		xteaStore8(data, v0, v1);
+	}
+	xteaEncryptBlocks(reinterpret_cast<uint32_t*>(data), blocks, schedule);
+}
+
+static AVX2_TARGET void xteaDecryptAVX2(uint8_t* data, size_t length, const uint32_t* key)
+{
+	XTEASchedule schedule;
+	getDecryptSchedule(key, schedule);
+
+	size_t blocks = length / 8;
+	for (; blocks >= 8; blocks -= 8, data += 64) {
+		__m256i v0, v1;
+		xteaLoad8(data, v0, v1);
+		for (uint32_t round = 0; round < XTEA_ROUNDS; ++round) {
+			v1 = _mm256_sub_epi32(v1, xteaMix(v0, _mm256_set1_epi32(schedule.first[round])));
+			v0 = _mm256_sub_epi32(v0, xteaMix(v1, _mm256_set1_epi32(schedule.second[round])));
+		}
+		xteaStore8(data, v0, v1);
+	}
+	xteaDecryptBlocks(reinterpret_cast<uint32_t*>(data), blocks, schedule);
+}
+
+static AVX2_TARGET inline uint32_t horizontalSum(__m256i v)
+{
+	__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	return static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+}
+
+static AVX2_TARGET uint32_t adler32AVX2(const uint8_t* data, size_t length)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi16(1);
+	const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+	                                         16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+
+	uint32_t a = 1, b = 0;
+	while (length > 0) {
+		size_t chunk = std::min(length, ADLER_NMAX);
+		length -= chunk;
+
+		size_t blocks = chunk / 32;
+		chunk -= blocks * 32;
+
+		__m256i sumA = zero, sumPrefix = zero, sumB = zero;
+		b += a * static_cast<uint32_t>(blocks * 32);
+		for (size_t i = 0; i < blocks; ++i, data += 32) {
+			__m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+			sumPrefix = _mm256_add_epi32(sumPrefix, sumA);
+			sumA = _mm256_add_epi32(sumA, _mm256_sad_epu8(bytes, zero));
+			sumB = _mm256_add_epi32(sumB, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+		}
+		b += 32 * horizontalSum(sumPrefix) + horizontalSum(sumB);
+		a += horizontalSum(sumA);
+
+		while (chunk-- > 0) {
+			a += *data++;
+			b += a;
+		}
+
+		a %= ADLER_BASE;
+		b %= ADLER_BASE;
+	}
+	return (b << 16) | a;
+}
+
+static bool hasAVX2()
+{
+#ifdef __GNUC__
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+
+	// the OS has to save the ymm registers too
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+		return false;
+	}
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+#endif
+
+struct PacketCryptoKernels
+{
+	const char* name;
+	void (*encrypt)(uint8_t*, size_t, const uint32_t*);
+	void (*decrypt)(uint8_t*, size_t, const uint32_t*);
+	uint32_t (*adler)(const uint8_t*, size_t);
+};
+
+// best first
+static std::vector<PacketCryptoKernels> getAvailableKernels()
+{
+	std::vector<PacketCryptoKernels> kernels;
+#ifdef PACKETCRYPTO_AVX2
+	if (hasAVX2()) {
+		kernels.push_back({"avx2", xteaEncryptAVX2, xteaDecryptAVX2, adler32AVX2});
+	}
+#endif
+#ifdef PACKETCRYPTO_SSE2
+	kernels.push_back({"sse2", xteaEncryptSSE2, xteaDecryptSSE2, adler32SSE2});
+#endif
+	kernels.push_back({"scalar", xteaEncryptScalar, xteaDecryptScalar, adler32Scalar});
+	return kernels;
+}
+
+static const PacketCryptoKernels& getKernels()
+{
+	static const PacketCryptoKernels kernels = getAvailableKernels().front();
+	return kernels;
+}
+
+void xteaEncrypt(uint8_t* data, size_t length, const uint32_t* key)
+{
+	getKernels().encrypt(data, length, key);
+}
+
+void xteaDecrypt(uint8_t* data, size_t length, const uint32_t* key)
+{
+	getKernels().decrypt(data, length, key);
+}
+
+uint32_t adler32(const uint8_t* data, size_t length)
+{
+	return getKernels().adler(data, length);
+}
+
+const char* getPacketCryptoImplementation()
+{
+	return getKernels().name;
+}
+
+std::string benchmarkPacketCrypto(uint32_t megabytes)
+{
+	// the size of a large map description packet
+	const size_t packetSize = NETWORKMESSAGE_MAXSIZE & ~7;
+	const size_t iterations = std::max<size_t>(1, (static_cast<size_t>(megabytes) << 20) / packetSize);
+	const uint32_t key[4] = {0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543210};
+
+	std::vector<uint8_t> original(packetSize);
+	for (size_t i = 0; i < packetSize; ++i) {
+		original[i] = static_cast<uint8_t>(i * 7 + (i >> 8));
+	}
+
+	std::vector<uint8_t> expected = original;
+	xteaEncryptScalar(expected.data(), packetSize, key);
+	const uint32_t expectedChecksum = adler32Scalar(original.data(), packetSize);
+
+	auto throughput = [&](int64_t start) {
+		int64_t elapsed = std::max<int64_t>(1, OTSYS_TIME() - start);
+		return static_cast<uint64_t>(iterations * packetSize * 1000 / elapsed) >> 20;
+	};
+
+	std::ostringstream ss;
+	ss << "Packet crypto over " << iterations << " packets of " << packetSize << " bytes (MB/s), using " << getPacketCryptoImplementation() << std::endl;
+	for (const PacketCryptoKernels& kernels : getAvailableKernels()) {
+		std::vector<uint8_t> buffer = original;
+
+		kernels.encrypt(buffer.data(), packetSize, key);
+		bool valid = buffer == expected;
+		kernels.decrypt(buffer.data(), packetSize, key);
+		valid = valid && buffer == original && kernels.adler(buffer.data(), packetSize) == expectedChecksum;
+
+		int64_t start = OTSYS_TIME();
+		for (size_t i = 0; i < iterations; ++i) {
+			kernels.encrypt(buffer.data(), packetSize, key);
+		}
+		uint64_t encryptSpeed = throughput(start);
+
+		start = OTSYS_TIME();
+		for (size_t i = 0; i < iterations; ++i) {
+			kernels.decrypt(buffer.data(), packetSize, key);
+		}
+		uint64_t decryptSpeed = throughput(start);
+
+		// every packet is the same, so an odd count leaves the checksum itself
+		uint32_t checksum = 0;
+		start = OTSYS_TIME();
+		for (size_t i = 0; i < iterations; ++i) {
+			checksum ^= kernels.adler(buffer.data(), packetSize);
+		}
+		uint64_t adlerSpeed = throughput(start);
+
+		valid = valid && checksum == (iterations % 2 != 0 ? expectedChecksum : 0);
+
+		ss << kernels.name << ": xtea encrypt " << encryptSpeed << ", decrypt " << decryptSpeed << ", adler32 " << adlerSpeed;
+		if (!valid) {
+			ss << " (results differ from scalar!)";
+		}
+		ss << std::endl;
+	}
+	return ss.str();
+}
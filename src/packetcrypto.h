@@ -0,0 +1,38 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_PACKETCRYPTO_H_E948F9DD63314B0E8E7973745A8F8ED9
+#define FS_PACKETCRYPTO_H_E948F9DD63314B0E8E7973745A8F8ED9
+
+// XTEA and Adler-32 over whole packets. The best implementation the CPU
+// supports (AVX2, SSE2 or scalar) is picked on first use.
+
+// length must be a multiple of 8, blocks are encrypted independently
+void xteaEncrypt(uint8_t* data, size_t length, const uint32_t* key);
+void xteaDecrypt(uint8_t* data, size_t length, const uint32_t* key);
+
+uint32_t adler32(const uint8_t* data, size_t length);
+
+const char* getPacketCryptoImplementation();
+
+// Runs every implementation available on this CPU over the given amount of
+// data and returns their throughput in MB/s
+std::string benchmarkPacketCrypto(uint32_t megabytes);
+
+#endif
@@ -0,0 +1,251 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include "pathfinder.h"
+#include "game.h"
+#include "tasks.h"
+
+extern Dispatcher g_dispatcher;
+extern Game g_game;
+
+// PathSnapshot
+
+void PathSnapshot::build(Map& map, const Creature& creature, int32_t radius)
+{
+	startPos = creature.getPosition();
+	this->radius = std::min<int32_t>(radius, PATH_SNAPSHOT_MAX_RADIUS);
+
+	const PathClass_t pathClass = Map::getPathClass(creature);
+
+	std::vector<Position> checks;
+	for (int32_t dy = -this->radius; dy <= this->radius; ++dy) {
+		for (int32_t dx = -this->radius; dx <= this->radius; ++dx) {
+			Cell& cell = cells[dy + PATH_SNAPSHOT_MAX_RADIUS][dx + PATH_SNAPSHOT_MAX_RADIUS];
+			cell.extraCost = 0;
+
+			const int32_t x = startPos.x + dx;
+			const int32_t y = startPos.y + dy;
+			if (x < 0 || x > 0xFFFF || y < 0 || y > 0xFFFF) {
+				cell.flags = CELL_BLOCKED | CELL_BLOCKPROJECTILE;
+				continue;
+			}
+
+			const uint16_t flags = map.getWalkability(x, y, startPos.z);
+			cell.flags = (flags & WALKABILITY_BLOCKPROJECTILE) ? CELL_BLOCKPROJECTILE : 0;
+
+			if (dx == 0 && dy == 0) {
+				// like Map::canWalkTo, the own tile is never blocked
+				checks.emplace_back(x, y, startPos.z);
+			} else if (Map::isPathBlocked(flags, pathClass)) {
+				cell.flags |= CELL_BLOCKED;
+			} else if (flags & (WALKABILITY_MAGICFIELD | WALKABILITY_NOFIELDBLOCKPATH | WALKABILITY_HOUSE)) {
+				checks.emplace_back(x, y, startPos.z);
+			}
+		}
+	}
+
+	SpectatorVec spectators;
+	map.getSpectators(spectators, startPos, false, false, this->radius, this->radius, this->radius, this->radius);
+	for (Creature* spectator : spectators) {
+		const Position& pos = spectator->getPosition();
+		const Cell* cell = getCell(pos);
+		if (cell && !(cell->flags & CELL_BLOCKED) && pos != startPos) {
+			checks.push_back(pos);
+		}
+	}
+
+	for (const Position& pos : checks) {
+		Cell& cell = cells[pos.y - startPos.y + PATH_SNAPSHOT_MAX_RADIUS][pos.x - startPos.x + PATH_SNAPSHOT_MAX_RADIUS];
+		const Tile* tile = map.canWalkTo(creature, pos);
+		if (tile) {
+			cell.extraCost = AStarNodes::getTileWalkCost(creature, tile);
+		} else {
+			cell.flags |= CELL_BLOCKED;
+		}
+	}
+}
+
+const PathSnapshot::Cell* PathSnapshot::getCell(const Position& pos) const
+{
+	const int32_t dx = Position::getOffsetX(pos, startPos);
+	const int32_t dy = Position::getOffsetY(pos, startPos);
+	if (pos.z != startPos.z || std::abs(dx) > radius || std::abs(dy) > radius) {
+		return nullptr;
+	}
+	return &cells[dy + PATH_SNAPSHOT_MAX_RADIUS][dx + PATH_SNAPSHOT_MAX_RADIUS];
+}
+
+bool PathSnapshot::isMatch(const FrozenPathingConditionCall& pathCondition, const Position& startPos, const Position& testPos,
+                           const FindPathParams& fpp, int32_t& bestMatchDist) const
+{
+	if (!pathCondition.isInRange(startPos, testPos, fpp)) {
+		return false;
+	}
+
+	if (fpp.clearSight && !isSightClear(testPos, pathCondition.getTargetPos())) {
+		return false;
+	}
+	return pathCondition.isDistanceMatch(testPos, fpp, bestMatchDist);
+}
+
+bool PathSnapshot::getWalkCost(const Position& pos, bool known, int_fast32_t& extraCost) const
+{
+	const Cell* cell = getCell(pos);
+	if (!cell || (!known && (cell->flags & CELL_BLOCKED))) {
+		return false;
+	}
+
+	extraCost = cell->extraCost;
+	return true;
+}
+
+bool PathSnapshot::checkSightLine(const Position& fromPos, const Position& toPos) const
+{
+	if (fromPos == toPos) {
+		return true;
+	}
+
+	bool blocked = false;
+	walkSightLine(fromPos, toPos, [this, &blocked](const Position& pos) {
+		const Cell* cell = getCell(pos);
+		blocked = !cell || (cell->flags & CELL_BLOCKPROJECTILE);
+		return blocked;
+	});
+	return !blocked;
+}
+
+bool PathSnapshot::isSightClear(const Position& fromPos, const Position& toPos) const
+{
+	// same as Map::isSightClear with floorCheck, outside the snapshot counts as blocked
+	if (fromPos.z != toPos.z) {
+		return false;
+	}
+	return checkSightLine(fromPos, toPos) || checkSightLine(toPos, fromPos);
+}
+
+// Pathfinder
+
+void Pathfinder::start(uint32_t threadCount)
+{
+	if (threadCount == 0) {
+		return;
+	}
+
+	setState(THREAD_STATE_RUNNING);
+	for (uint32_t i = 0; i < threadCount; ++i) {
+		threads.emplace_back(&Pathfinder::run, this);
+	}
+}
+
+void Pathfinder::run()
+{
+	std::unique_lock<std::mutex> requestLockUnique(requestLock, std::defer_lock);
+	while (getState() != THREAD_STATE_TERMINATED) {
+		requestLockUnique.lock();
+		if (requests.empty()) {
+			requestSignal.wait(requestLockUnique);
+		}
+
+		if (!requests.empty() && getState() != THREAD_STATE_TERMINATED) {
+			std::unique_ptr<PathRequest> request = std::move(requests.front());
+			requests.pop_front();
+			requestLockUnique.unlock();
+			runRequest(*request);
+		} else {
+			requestLockUnique.unlock();
+		}
+	}
+}
+
+bool Pathfinder::requestPath(Creature& creature, const Position& targetPos, const FindPathParams& fpp)
+{
+	// unbounded searches may leave any snapshot, see Map::getLongPath
+	if (getState() != THREAD_STATE_RUNNING || !creature.getMonster() || fpp.maxSearchDist <= 0 ||
+	        targetPos.z != creature.getPosition().z) {
+		return false;
+	}
+
+	// the sight checks towards the target reach past the searched area, a
+	// snapshot too small for them would see blocked cells the map does not have
+	const int32_t radius = fpp.maxSearchDist + std::max<int32_t>(1, fpp.maxTargetDist);
+	if (radius > PATH_SNAPSHOT_MAX_RADIUS) {
+		return false;
+	}
+
+	std::unique_ptr<PathRequest> request(new PathRequest);
+	request->creatureId = creature.getID();
+	request->requestId = creature.getPathRequestId();
+	request->targetPos = targetPos;
+	request->fpp = fpp;
+	request->snapshot.build(g_game.map, creature, radius);
+
+	bool signal = false;
+	requestLock.lock();
+	if (getState() == THREAD_STATE_RUNNING && requests.size() < maxPendingRequests) {
+		signal = true;
+		requests.push_back(std::move(request));
+	}
+	requestLock.unlock();
+
+	if (!signal) {
+		return false;
+	}
+
+	requestSignal.notify_one();
+	return true;
+}
+
+void Pathfinder::runRequest(const PathRequest& request)
+{
+	std::forward_list<Direction> dirList;
+	bool found = Map::getPathMatching(request.snapshot, dirList, FrozenPathingConditionCall(request.targetPos), request.fpp);
+
+	uint32_t creatureId = request.creatureId;
+	uint32_t requestId = request.requestId;
+	Position startPos = request.snapshot.getStartPos();
+
+	Task* task = createTask([creatureId, requestId, startPos, found, dirList]() {
+		Creature* creature = g_game.getCreatureByID(creatureId);
+		if (creature) {
+			creature->onPathFound(requestId, startPos, found, dirList);
+		}
+	});
+	task->setOrigin(TASK_ORIGIN_PATHFINDER);
+	g_dispatcher.addTask(task);
+}
+
+void Pathfinder::shutdown()
+{
+	requestLock.lock();
+	setState(THREAD_STATE_TERMINATED);
+	requests.clear();
+	requestLock.unlock();
+	requestSignal.notify_all();
+}
+
+void Pathfinder::join()
+{
+	for (std::thread& thread : threads) {
+		if (thread.joinable()) {
+			thread.join();
+		}
+	}
+}
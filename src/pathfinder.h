@@ -0,0 +1,122 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_PATHFINDER_H_B0CA1EC84B9346538E7B42DCF6899C89
+#define FS_PATHFINDER_H_B0CA1EC84B9346538E7B42DCF6899C89
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <thread>
+
+#include "creature.h"
+#include "enums.h"
+
+class Map;
+
+#define PATH_SNAPSHOT_MAX_RADIUS 16
+#define PATH_SNAPSHOT_SIZE (PATH_SNAPSHOT_MAX_RADIUS * 2 + 1)
+
+// What a path search of one creature needs to know about the area around
+// it, taken on the dispatcher so the search itself can run on any thread.
+// Plain tiles are judged by their walkability flags, tiles with creatures,
+// fields or other conditional blockers are asked directly while building.
+class PathSnapshot
+{
+	public:
+		void build(Map& map, const Creature& creature, int32_t radius);
+
+		const Position& getStartPos() const {
+			return startPos;
+		}
+
+		// the interface Map::getPathMatching expects from a search area
+		bool isMatch(const FrozenPathingConditionCall& pathCondition, const Position& startPos, const Position& testPos,
+		             const FindPathParams& fpp, int32_t& bestMatchDist) const;
+		bool getWalkCost(const Position& pos, bool known, int_fast32_t& extraCost) const;
+
+		bool isSightClear(const Position& fromPos, const Position& toPos) const;
+
+	private:
+		enum CellFlags : uint8_t {
+			CELL_BLOCKED = 1 << 0,
+			CELL_BLOCKPROJECTILE = 1 << 1,
+		};
+
+		struct Cell {
+			uint16_t extraCost;
+			uint8_t flags;
+		};
+
+		const Cell* getCell(const Position& pos) const;
+		bool checkSightLine(const Position& fromPos, const Position& toPos) const;
+
+		Position startPos;
+		int32_t radius = 0;
+		Cell cells[PATH_SNAPSHOT_SIZE][PATH_SNAPSHOT_SIZE]; // [y][x], relative to startPos
+};
+
+struct PathRequest {
+	uint32_t creatureId;
+	uint32_t requestId;
+	Position targetPos;
+	FindPathParams fpp;
+	PathSnapshot snapshot;
+};
+
+// Worker threads for the follow path searches of monsters. The result is
+// handed back to the creature as a dispatcher task and dropped there if
+// the creature asked for another path or moved in the meantime.
+class Pathfinder
+{
+	public:
+		void start(uint32_t threadCount);
+		void shutdown();
+		void join();
+
+		/**
+		  * Queues a path search for a creature.
+		  * \returns false if it has to be searched right away instead
+		  */
+		bool requestPath(Creature& creature, const Position& targetPos, const FindPathParams& fpp);
+
+		static const size_t maxPendingRequests = 4096;
+
+	private:
+		void run();
+		static void runRequest(const PathRequest& request);
+
+		void setState(ThreadState newState) {
+			threadState.store(newState, std::memory_order_relaxed);
+		}
+
+		ThreadState getState() const {
+			return threadState.load(std::memory_order_relaxed);
+		}
+
+		std::vector<std::thread> threads;
+		std::list<std::unique_ptr<PathRequest>> requests;
+		std::mutex requestLock;
+		std::condition_variable requestSignal;
+		std::atomic<ThreadState> threadState {THREAD_STATE_TERMINATED};
+};
+
+extern Pathfinder g_pathfinder;
+
+#endif
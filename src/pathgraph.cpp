@@ -0,0 +1,338 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include <queue>
+
+#include "pathgraph.h"
+#include "map.h"
+
+void PathGraph::markDirty(uint16_t x, uint16_t y, uint8_t z)
+{
+	if (clusters.empty()) {
+		return;
+	}
+
+	auto invalidate = [this, z](uint16_t x, uint16_t y) {
+		for (uint8_t pathClass = PATHCLASS_CREATURE; pathClass <= PATHCLASS_LAST; ++pathClass) {
+			auto it = clusters.find(getClusterKey(static_cast<PathClass_t>(pathClass), x, y, z));
+			if (it != clusters.end()) {
+				it->second.valid = false;
+			}
+		}
+	};
+
+	invalidate(x, y);
+
+	// tiles on a border also decide the portals of the neighbor cluster
+	if ((x & PATH_CLUSTER_MASK) == 0 && x != 0) {
+		invalidate(x - 1, y);
+	} else if ((x & PATH_CLUSTER_MASK) == PATH_CLUSTER_MASK && x != 0xFFFF) {
+		invalidate(x + 1, y);
+	}
+
+	if ((y & PATH_CLUSTER_MASK) == 0 && y != 0) {
+		invalidate(x, y - 1);
+	} else if ((y & PATH_CLUSTER_MASK) == PATH_CLUSTER_MASK && y != 0xFFFF) {
+		invalidate(x, y + 1);
+	}
+}
+
+PathGraph::Cluster& PathGraph::getCluster(const Map& map, PathClass_t pathClass, uint16_t x, uint16_t y, uint8_t z)
+{
+	Cluster& cluster = clusters[getClusterKey(pathClass, x, y, z)];
+	if (!cluster.valid) {
+		buildCluster(map, pathClass, x & ~PATH_CLUSTER_MASK, y & ~PATH_CLUSTER_MASK, z, cluster);
+	}
+	return cluster;
+}
+
+void PathGraph::findBorderPortals(const Map& map, PathClass_t pathClass, uint16_t x, uint16_t y, uint8_t z, bool vertical,
+                                  std::vector<uint16_t>& offsets)
+{
+	// x, y is the first tile on the west or north side of the border
+	offsets.clear();
+
+	auto isOpen = [&](uint16_t offset) {
+		uint16_t sideX = vertical ? x : x + offset;
+		uint16_t sideY = vertical ? y + offset : y;
+		if (Map::isPathBlocked(map.getWalkability(sideX, sideY, z), pathClass)) {
+			return false;
+		}
+		return !Map::isPathBlocked(map.getWalkability(vertical ? sideX + 1 : sideX, vertical ? sideY : sideY + 1, z), pathClass);
+	};
+
+	int32_t runStart = -1;
+	for (int32_t offset = 0; offset <= PATH_CLUSTER_SIZE; ++offset) {
+		if (offset != PATH_CLUSTER_SIZE && isOpen(offset)) {
+			if (runStart == -1) {
+				runStart = offset;
+			}
+			continue;
+		}
+
+		if (runStart != -1) {
+			// short openings get one portal in the middle, wide ones one at each end
+			int32_t runEnd = offset - 1;
+			if (runEnd - runStart < 5) {
+				offsets.push_back((runStart + runEnd) / 2);
+			} else {
+				offsets.push_back(runStart);
+				offsets.push_back(runEnd);
+			}
+			runStart = -1;
+		}
+	}
+}
+
+void PathGraph::searchCluster(const Map& map, PathClass_t pathClass, uint16_t originX, uint16_t originY, uint8_t z,
+                              uint16_t x, uint16_t y, ClusterCosts& costs)
+{
+	std::fill(&costs[0][0], &costs[0][0] + PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE, PATH_COST_UNREACHABLE);
+
+	static const int_fast32_t steps[8][2] = {
+		{0, -1}, {1, 0}, {0, 1}, {-1, 0}, {-1, 1}, {1, 1}, {-1, -1}, {1, -1}
+	};
+
+	// the start itself may be blocked, a target creature or item is allowed to stand on it
+	typedef std::pair<uint_fast32_t, uint_fast32_t> QueueEntry; // cost, y * size + x
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+	costs[y - originY][x - originX] = 0;
+	queue.emplace(0, (y - originY) * PATH_CLUSTER_SIZE + (x - originX));
+
+	while (!queue.empty()) {
+		const QueueEntry entry = queue.top();
+		queue.pop();
+
+		const int_fast32_t cx = entry.second % PATH_CLUSTER_SIZE;
+		const int_fast32_t cy = entry.second / PATH_CLUSTER_SIZE;
+		if (entry.first != costs[cy][cx]) {
+			continue;
+		}
+
+		for (const auto& step : steps) {
+			const int_fast32_t nx = cx + step[0];
+			const int_fast32_t ny = cy + step[1];
+			if (nx < 0 || nx >= PATH_CLUSTER_SIZE || ny < 0 || ny >= PATH_CLUSTER_SIZE) {
+				continue;
+			}
+
+			const uint_fast32_t cost = entry.first + (step[0] != 0 && step[1] != 0 ? MAP_DIAGONALWALKCOST : MAP_NORMALWALKCOST);
+			if (cost >= costs[ny][nx] || Map::isPathBlocked(map.getWalkability(originX + nx, originY + ny, z), pathClass)) {
+				continue;
+			}
+
+			costs[ny][nx] = cost;
+			queue.emplace(cost, ny * PATH_CLUSTER_SIZE + nx);
+		}
+	}
+}
+
+void PathGraph::buildCluster(const Map& map, PathClass_t pathClass, uint16_t originX, uint16_t originY, uint8_t z, Cluster& cluster)
+{
+	cluster.entrances.clear();
+	cluster.valid = true;
+
+	auto addEntrance = [&cluster](uint16_t x, uint16_t y, uint16_t partnerX, uint16_t partnerY) {
+		auto it = std::find_if(cluster.entrances.begin(), cluster.entrances.end(), [x, y](const Cluster::Entrance& entrance) {
+			return entrance.x == x && entrance.y == y;
+		});
+		if (it == cluster.entrances.end()) {
+			cluster.entrances.emplace_back();
+			it = cluster.entrances.end() - 1;
+			it->x = x;
+			it->y = y;
+		}
+		it->partners.push_back((static_cast<uint32_t>(partnerX) << 16) | partnerY);
+	};
+
+	const uint16_t lastX = originX + PATH_CLUSTER_MASK;
+	const uint16_t lastY = originY + PATH_CLUSTER_MASK;
+
+	std::vector<uint16_t> offsets;
+	if (originX != 0) {
+		findBorderPortals(map, pathClass, originX - 1, originY, z, true, offsets);
+		for (uint16_t offset : offsets) {
+			addEntrance(originX, originY + offset, originX - 1, originY + offset);
+		}
+	}
+
+	if (lastX != 0xFFFF) {
+		findBorderPortals(map, pathClass, lastX, originY, z, true, offsets);
+		for (uint16_t offset : offsets) {
+			addEntrance(lastX, originY + offset, lastX + 1, originY + offset);
+		}
+	}
+
+	if (originY != 0) {
+		findBorderPortals(map, pathClass, originX, originY - 1, z, false, offsets);
+		for (uint16_t offset : offsets) {
+			addEntrance(originX + offset, originY, originX + offset, originY - 1);
+		}
+	}
+
+	if (lastY != 0xFFFF) {
+		findBorderPortals(map, pathClass, originX, lastY, z, false, offsets);
+		for (uint16_t offset : offsets) {
+			addEntrance(originX + offset, lastY, originX + offset, lastY + 1);
+		}
+	}
+
+	const size_t size = cluster.entrances.size();
+	cluster.costs.assign(size * size, PATH_COST_UNREACHABLE);
+
+	ClusterCosts costs;
+	for (size_t from = 0; from < size; ++from) {
+		const Cluster::Entrance& entrance = cluster.entrances[from];
+		searchCluster(map, pathClass, originX, originY, z, entrance.x, entrance.y, costs);
+		for (size_t to = 0; to < size; ++to) {
+			const Cluster::Entrance& other = cluster.entrances[to];
+			cluster.costs[from * size + to] = costs[other.y - originY][other.x - originX];
+		}
+	}
+}
+
+bool PathGraph::findWaypoints(const Map& map, PathClass_t pathClass, const Position& startPos, const Position& targetPos,
+                              std::vector<Position>& waypoints)
+{
+	const uint8_t z = startPos.z;
+	const uint64_t targetKey = getClusterKey(pathClass, targetPos.x, targetPos.y, z);
+	if (getClusterKey(pathClass, startPos.x, startPos.y, z) == targetKey) {
+		return false;
+	}
+
+	if (clusters.size() >= maxClusters) {
+		clear();
+	}
+
+	const uint16_t startOriginX = startPos.x & ~PATH_CLUSTER_MASK;
+	const uint16_t startOriginY = startPos.y & ~PATH_CLUSTER_MASK;
+	const uint16_t targetOriginX = targetPos.x & ~PATH_CLUSTER_MASK;
+	const uint16_t targetOriginY = targetPos.y & ~PATH_CLUSTER_MASK;
+
+	ClusterCosts startCosts, targetCosts;
+	searchCluster(map, pathClass, startOriginX, startOriginY, z, startPos.x, startPos.y, startCosts);
+	searchCluster(map, pathClass, targetOriginX, targetOriginY, z, targetPos.x, targetPos.y, targetCosts);
+
+	static const uint32_t START_NODE = 0xFFFFFFFE;
+	static const uint32_t TARGET_NODE = 0xFFFFFFFF;
+
+	struct Node {
+		uint32_t cost;
+		uint32_t parent;
+		bool closed;
+	};
+
+	std::unordered_map<uint32_t, Node> nodes;
+	typedef std::pair<uint32_t, uint32_t> QueueEntry; // estimated cost, node
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+	auto addNode = [&](uint32_t node, uint32_t parent, uint32_t cost) {
+		auto result = nodes.emplace(node, Node {cost, parent, false});
+		if (!result.second) {
+			Node& existing = result.first->second;
+			if (existing.closed || existing.cost <= cost) {
+				return;
+			}
+			existing.cost = cost;
+			existing.parent = parent;
+		}
+
+		uint32_t estimate = cost;
+		if (node != TARGET_NODE) {
+			// walking diagonally costs more than two straight steps
+			estimate += MAP_NORMALWALKCOST * (Position::getDistanceX(Position(node >> 16, node & 0xFFFF, z), targetPos) +
+			                                  Position::getDistanceY(Position(node >> 16, node & 0xFFFF, z), targetPos));
+		}
+		queue.emplace(estimate, node);
+	};
+
+	nodes.emplace(START_NODE, Node {0, START_NODE, true});
+	for (const Cluster::Entrance& entrance : getCluster(map, pathClass, startPos.x, startPos.y, z).entrances) {
+		uint16_t cost = startCosts[entrance.y - startOriginY][entrance.x - startOriginX];
+		if (cost != PATH_COST_UNREACHABLE) {
+			addNode((static_cast<uint32_t>(entrance.x) << 16) | entrance.y, START_NODE, cost);
+		}
+	}
+
+	size_t expandedNodes = 0;
+	while (!queue.empty()) {
+		const uint32_t node = queue.top().second;
+		queue.pop();
+
+		Node& current = nodes[node];
+		if (current.closed) {
+			continue;
+		}
+		current.closed = true;
+
+		const uint32_t cost = current.cost;
+		if (node == TARGET_NODE) {
+			break;
+		}
+
+		if (++expandedNodes > maxExpandedNodes) {
+			return false;
+		}
+
+		const uint16_t x = node >> 16;
+		const uint16_t y = node & 0xFFFF;
+		const Cluster& cluster = getCluster(map, pathClass, x, y, z);
+		auto it = std::find_if(cluster.entrances.begin(), cluster.entrances.end(), [x, y](const Cluster::Entrance& entrance) {
+			return entrance.x == x && entrance.y == y;
+		});
+		if (it == cluster.entrances.end()) {
+			continue;
+		}
+
+		if (getClusterKey(pathClass, x, y, z) == targetKey) {
+			uint16_t targetCost = targetCosts[y - targetOriginY][x - targetOriginX];
+			if (targetCost != PATH_COST_UNREACHABLE) {
+				addNode(TARGET_NODE, node, cost + targetCost);
+			}
+		}
+
+		const size_t size = cluster.entrances.size();
+		const size_t from = it - cluster.entrances.begin();
+		for (size_t to = 0; to < size; ++to) {
+			uint16_t edgeCost = cluster.costs[from * size + to];
+			if (to != from && edgeCost != PATH_COST_UNREACHABLE) {
+				const Cluster::Entrance& other = cluster.entrances[to];
+				addNode((static_cast<uint32_t>(other.x) << 16) | other.y, node, cost + edgeCost);
+			}
+		}
+
+		for (uint32_t partner : it->partners) {
+			addNode(partner, node, cost + MAP_NORMALWALKCOST);
+		}
+	}
+
+	auto targetIt = nodes.find(TARGET_NODE);
+	if (targetIt == nodes.end() || !targetIt->second.closed) {
+		return false;
+	}
+
+	waypoints.clear();
+	for (uint32_t node = targetIt->second.parent; node != START_NODE; node = nodes[node].parent) {
+		waypoints.emplace_back(node >> 16, node & 0xFFFF, z);
+	}
+	std::reverse(waypoints.begin(), waypoints.end());
+	return true;
+}
@@ -0,0 +1,97 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_PATHGRAPH_H_0FCC514C6396449AB8C04D9F69ADA30B
+#define FS_PATHGRAPH_H_0FCC514C6396449AB8C04D9F69ADA30B
+
+#include "position.h"
+#include "walkability.h"
+
+class Map;
+
+#define PATH_CLUSTER_BITS 4
+#define PATH_CLUSTER_SIZE (1 << PATH_CLUSTER_BITS)
+#define PATH_CLUSTER_MASK (PATH_CLUSTER_SIZE - 1)
+#define PATH_COST_UNREACHABLE 0xFFFF
+
+// Abstract graph for long paths. The map is cut into clusters of
+// PATH_CLUSTER_SIZE x PATH_CLUSTER_SIZE tiles, every open stretch of a
+// cluster border gets one or two portals and the walk costs between the
+// portals of a cluster are searched in advance. A long path is found on
+// the portals first and then refined leg by leg with the regular A*.
+// Clusters are built on first use and rebuilt when one of their tiles
+// changes its walkability flags.
+class PathGraph
+{
+	public:
+		PathGraph() = default;
+
+		// non-copyable
+		PathGraph(const PathGraph&) = delete;
+		PathGraph& operator=(const PathGraph&) = delete;
+
+		/**
+		  * Finds the portals a path from startPos to targetPos passes, in walk order.
+		  * Both positions have to be on the same floor.
+		  * \returns false if the portals do not connect them
+		  */
+		bool findWaypoints(const Map& map, PathClass_t pathClass, const Position& startPos, const Position& targetPos,
+		                   std::vector<Position>& waypoints);
+
+		void markDirty(uint16_t x, uint16_t y, uint8_t z);
+		void clear() {
+			clusters.clear();
+		}
+		bool empty() const {
+			return clusters.empty();
+		}
+
+		static const size_t maxClusters = 65536;
+		static const size_t maxExpandedNodes = 8192;
+
+	private:
+		struct Cluster {
+			struct Entrance {
+				uint16_t x, y;
+				std::vector<uint32_t> partners; // entrances of the neighbor clusters, x << 16 | y
+			};
+
+			std::vector<Entrance> entrances;
+			std::vector<uint16_t> costs; // entrances.size() squared, from * size + to
+			bool valid = false;
+		};
+
+		typedef uint16_t ClusterCosts[PATH_CLUSTER_SIZE][PATH_CLUSTER_SIZE]; // [y][x]
+
+		static uint64_t getClusterKey(PathClass_t pathClass, uint16_t x, uint16_t y, uint8_t z) {
+			return (static_cast<uint64_t>(pathClass) << 40) | (static_cast<uint64_t>(z) << 32) |
+			       (static_cast<uint64_t>(x >> PATH_CLUSTER_BITS) << 16) | (y >> PATH_CLUSTER_BITS);
+		}
+
+		Cluster& getCluster(const Map& map, PathClass_t pathClass, uint16_t x, uint16_t y, uint8_t z);
+		void buildCluster(const Map& map, PathClass_t pathClass, uint16_t originX, uint16_t originY, uint8_t z, Cluster& cluster);
+		static void findBorderPortals(const Map& map, PathClass_t pathClass, uint16_t x, uint16_t y, uint8_t z, bool vertical,
+		                              std::vector<uint16_t>& offsets);
+		static void searchCluster(const Map& map, PathClass_t pathClass, uint16_t originX, uint16_t originY, uint8_t z,
+		                          uint16_t x, uint16_t y, ClusterCosts& costs);
+
+		std::unordered_map<uint64_t, Cluster> clusters;
+};
+
+#endif
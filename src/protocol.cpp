@@ -23,26 +23,35 @@
 #include "scheduler.h"
 #include "connection.h"
 #include "outputmessage.h"
+#include "packetcrypto.h"
 #include "rsa.h"
 
 extern RSA g_RSA;
 
 void Protocol::onSendMessage(OutputMessage_ptr msg)
 {
-	if (!m_rawMessages) {
-		msg->writeMessageLength();
-
-		if (m_encryptionEnabled) {
-			XTEA_encrypt(*msg);
-			msg->addCryptoHeader(m_checksumEnabled);
-		}
-	}
+	// the message is finalized on the network thread by encodeMessage
+	msg->setEncoding(m_rawMessages, m_encryptionEnabled, m_checksumEnabled, m_key);
 
 	if (msg == m_outputBuffer) {
 		m_outputBuffer.reset();
 	}
 }
 
+void Protocol::encodeMessage(OutputMessage& msg)
+{
+	if (msg.rawMessage) {
+		return;
+	}
+
+	msg.writeMessageLength();
+
+	if (msg.encryptionEnabled) {
+		XTEA_encrypt(msg);
+		msg.addCryptoHeader(msg.checksumEnabled);
+	}
+}
+
 void Protocol::onRecvMessage(NetworkMessage& msg)
 {
 	if (m_encryptionEnabled && !XTEA_decrypt(msg)) {
@@ -82,33 +91,15 @@ void Protocol::deleteProtocolTask()
 	delete this;
 }
 
-void Protocol::XTEA_encrypt(OutputMessage& msg) const
+void Protocol::XTEA_encrypt(OutputMessage& msg)
 {
-	const uint32_t delta = 0x61C88647;
-
 	// The message must be a multiple of 8
 	size_t paddingBytes = msg.getLength() % 8;
 	if (paddingBytes != 0) {
 		msg.addPaddingBytes(8 - paddingBytes);
 	}
 
-	uint32_t* buffer = reinterpret_cast<uint32_t*>(msg.getOutputBuffer());
-	const size_t messageLength = msg.getLength() / 4;
-	size_t readPos = 0;
-	const uint32_t k[] = {m_key[0], m_key[1], m_key[2], m_key[3]};
-	while (readPos < messageLength) {
-		uint32_t v0 = buffer[readPos], v1 = buffer[readPos + 1];
-		uint32_t sum = 0;
-
-		for (int32_t i = 32; --i >= 0;) {
-			v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + k[sum & 3]);
-			sum -= delta;
-			v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + k[(sum >> 11) & 3]);
-		}
-
-		buffer[readPos++] = v0;
-		buffer[readPos++] = v1;
-	}
+	xteaEncrypt(msg.getOutputBuffer(), msg.getLength(), msg.xteaKey);
 }
 
 bool Protocol::XTEA_decrypt(NetworkMessage& msg) const
@@ -117,25 +108,7 @@ bool Protocol::XTEA_decrypt(NetworkMessage& msg) const
 		return false;
 	}
 
-	const uint32_t delta = 0x61C88647;
-
-	uint32_t* buffer = reinterpret_cast<uint32_t*>(msg.getBuffer() + msg.getBufferPosition());
-	const size_t messageLength = (msg.getLength() - 6) / 4;
-	size_t readPos = 0;
-	const uint32_t k[] = {m_key[0], m_key[1], m_key[2], m_key[3]};
-	while (readPos < messageLength) {
-		uint32_t v0 = buffer[readPos], v1 = buffer[readPos + 1];
-		uint32_t sum = 0xC6EF3720;
-
-		for (int32_t i = 32; --i >= 0;) {
-			v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + k[(sum >> 11) & 3]);
-			sum += delta;
-			v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + k[sum & 3]);
-		}
-
-		buffer[readPos++] = v0;
-		buffer[readPos++] = v1;
-	}
+	xteaDecrypt(msg.getBuffer() + msg.getBufferPosition(), msg.getLength() - 6, m_key);
 
 	int innerLength = msg.get<uint16_t>();
 	if (innerLength > msg.getLength() - 8) {
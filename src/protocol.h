@@ -35,6 +35,7 @@ class Protocol
 		virtual void parsePacket(NetworkMessage&) {}
 
 		virtual void onSendMessage(OutputMessage_ptr msg);
+		static void encodeMessage(OutputMessage& msg);
 		void onRecvMessage(NetworkMessage& msg);
 		virtual void onRecvFirstMessage(NetworkMessage& msg) = 0;
 		virtual void onConnect() {}
@@ -75,7 +76,7 @@ class Protocol
 			m_checksumEnabled = false;
 		}
 
-		void XTEA_encrypt(OutputMessage& msg) const;
+		static void XTEA_encrypt(OutputMessage& msg);
 		bool XTEA_decrypt(NetworkMessage& msg) const;
 		static bool RSA_decrypt(NetworkMessage& msg);
 
@@ -92,7 +93,7 @@ class Protocol
 	private:
 		Connection_ptr m_connection;
 		uint32_t m_key[4];
-		uint32_t m_refCount;
+		std::atomic<uint32_t> m_refCount;
 		bool m_encryptionEnabled;
 		bool m_checksumEnabled;
 		bool m_rawMessages;
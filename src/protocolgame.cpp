@@ -53,13 +53,16 @@ extern Chat* g_chat;
 
 // Helping templates to add dispatcher tasks
 template<class FunctionType>
-void ProtocolGame::addGameTaskInternal(bool droppable, uint32_t delay, const FunctionType& func)
+void ProtocolGame::addGameTaskInternal(bool droppable, uint32_t delay, const FunctionType& func) const
 {
+	Task* task;
 	if (droppable) {
-		g_dispatcher.addTask(createTask(delay, func));
+		task = createTask(delay, func);
 	} else {
-		g_dispatcher.addTask(createTask(func));
+		task = createTask(func);
 	}
+	task->setOrigin(static_cast<TaskOrigin>(m_packetOpcode));
+	g_dispatcher.addTask(task);
 }
 
 ProtocolGame::ProtocolGame(Connection_ptr connection) :
@@ -69,6 +72,7 @@ ProtocolGame::ProtocolGame(Connection_ptr connection) :
 	// version(CLIENT_VERSION_MIN),
 	m_challengeTimestamp(0),
 	m_challengeRandom(0),
+	m_packetOpcode(0),
 	m_debugAssertSent(false),
 	m_acceptPackets(false)
 {
@@ -429,6 +433,7 @@ void ProtocolGame::parsePacket(NetworkMessage& msg)
 	}
 
 	uint8_t recvbyte = msg.getByte();
+	m_packetOpcode = recvbyte;
 
 	if (!player) {
 		if (recvbyte == 0x0F) {
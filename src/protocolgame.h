@@ -285,7 +285,7 @@ class ProtocolGame final : public Protocol
 #define addGameTaskTimed(delay, f, ...) ProtocolGame::addGameTaskInternal(true, delay, std::bind(f, &g_game, __VA_ARGS__))
 
 		template<class FunctionType>
-		static void addGameTaskInternal(bool droppable, uint32_t delay, const FunctionType&);
+		void addGameTaskInternal(bool droppable, uint32_t delay, const FunctionType&) const;
 
 		Player* player;
 
@@ -295,6 +295,9 @@ class ProtocolGame final : public Protocol
 		uint32_t m_challengeTimestamp;
 		uint8_t m_challengeRandom;
 
+		// opcode of the packet being parsed, tags the tasks it creates
+		uint8_t m_packetOpcode;
+
 		bool m_debugAssertSent;
 		bool m_acceptPackets;
 };
@@ -21,6 +21,23 @@
 
 #include "scheduler.h"
 
+void* SchedulerTask::operator new(size_t size)
+{
+	if (size != sizeof(SchedulerTask)) {
+		return ::operator new(size);
+	}
+	return LockfreePoolingAllocator<SchedulerTask, TASK_POOL_CAPACITY>::allocate();
+}
+
+void SchedulerTask::operator delete(void* p, size_t size)
+{
+	if (size != sizeof(SchedulerTask)) {
+		::operator delete(p);
+		return;
+	}
+	LockfreePoolingAllocator<SchedulerTask, TASK_POOL_CAPACITY>::deallocate(p);
+}
+
 Scheduler::Scheduler()
 {
 	lastEventId = 0;
@@ -29,47 +46,182 @@ Scheduler::Scheduler()
 
 void Scheduler::start()
 {
+	wheelStart = std::chrono::system_clock::now();
+	currentTick = 0;
+
 	threadState = THREAD_STATE_RUNNING;
 	thread = std::thread(&Scheduler::schedulerThread, this);
 }
 
 void Scheduler::schedulerThread()
 {
-	std::unique_lock<std::mutex> eventLockUnique(eventLock, std::defer_lock);
+	std::unique_lock<std::mutex> eventLockUnique(eventLock);
 	while (threadState != THREAD_STATE_TERMINATED) {
-		std::cv_status ret = std::cv_status::no_timeout;
+		auto now = std::chrono::system_clock::now();
+		advanceWheel(getTick(now));
 
-		eventLockUnique.lock();
-		if (eventList.empty()) {
-			eventSignal.wait(eventLockUnique);
-		} else {
-			ret = eventSignal.wait_until(eventLockUnique, eventList.top()->getCycle());
-		}
-
-		// the mutex is locked again now...
-		if (ret == std::cv_status::timeout && threadState != THREAD_STATE_TERMINATED) {
-			// ok we had a timeout, so there has to be an event we have to execute...
-			SchedulerTask* task = eventList.top();
-			eventList.pop();
+		if (!dueEvents.empty() && dueEvents.top()->getCycle() <= now) {
+			SchedulerTask* task = dueEvents.top();
+			dueEvents.pop();
 
 			// check if the event was stopped
-			auto it = eventIds.find(task->getEventId());
-			if (it == eventIds.end()) {
+			auto it = activeEvents.find(task->getEventId());
+			if (it == activeEvents.end() || it->second != task) {
 				eventLockUnique.unlock();
 				delete task;
+				eventLockUnique.lock();
 				continue;
 			}
-			eventIds.erase(it);
+			activeEvents.erase(it);
 			eventLockUnique.unlock();
 
+			task->setLateness(std::chrono::duration_cast<std::chrono::microseconds>(now - task->getCycle()).count());
 			task->setDontExpire();
 			g_dispatcher.addTask(task, true);
+
+			eventLockUnique.lock();
+		} else if (!dueEvents.empty()) {
+			eventSignal.wait_until(eventLockUnique, dueEvents.top()->getCycle());
+		} else if (wheelSize != 0) {
+			eventSignal.wait_until(eventLockUnique, getTickTime(currentTick + 1));
 		} else {
-			eventLockUnique.unlock();
+			eventSignal.wait(eventLockUnique);
 		}
 	}
 }
 
+uint64_t Scheduler::getTick(std::chrono::system_clock::time_point timePoint) const
+{
+	int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(timePoint - wheelStart).count();
+	if (ms <= 0) {
+		return 0;
+	}
+	return ms / SCHEDULER_MINTICKS;
+}
+
+std::chrono::system_clock::time_point Scheduler::getTickTime(uint64_t tick) const
+{
+	return wheelStart + std::chrono::milliseconds(tick * SCHEDULER_MINTICKS);
+}
+
+bool Scheduler::scheduleEvent(SchedulerTask* task)
+{
+	uint64_t tick = getTick(task->getCycle());
+	if (tick <= currentTick) {
+		dueEvents.push(task);
+		return dueEvents.top() == task;
+	}
+
+	linkEvent(task, tick);
+
+	// the scheduler thread sleeps without a timeout when it has nothing to do
+	return wheelSize == 1 && dueEvents.empty();
+}
+
+void Scheduler::linkEvent(SchedulerTask* task, uint64_t tick)
+{
+	uint64_t delta = tick - currentTick;
+
+	uint32_t slot;
+	if (delta < SCHEDULER_WHEEL_ROOT_SLOTS) {
+		slot = tick & (SCHEDULER_WHEEL_ROOT_SLOTS - 1);
+	} else {
+		uint32_t level = 1;
+		uint32_t shift = SCHEDULER_WHEEL_ROOT_BITS;
+		while (level < SCHEDULER_WHEEL_LEVELS - 1 && delta >= (static_cast<uint64_t>(1) << (shift + SCHEDULER_WHEEL_LEVEL_BITS))) {
+			++level;
+			shift += SCHEDULER_WHEEL_LEVEL_BITS;
+		}
+
+		// events beyond the last level wait in its farthest slot and get
+		// cascaded again until they are in range
+		uint64_t maxDelta = (static_cast<uint64_t>(1) << (shift + SCHEDULER_WHEEL_LEVEL_BITS)) - 1;
+		if (delta > maxDelta) {
+			tick = currentTick + maxDelta;
+		}
+
+		slot = SCHEDULER_WHEEL_ROOT_SLOTS + (level - 1) * SCHEDULER_WHEEL_LEVEL_SLOTS + ((tick >> shift) & (SCHEDULER_WHEEL_LEVEL_SLOTS - 1));
+	}
+
+	SchedulerTask*& head = wheel[slot];
+	task->wheelSlot = &head;
+	task->wheelPrev = nullptr;
+	task->wheelNext = head;
+	if (head) {
+		head->wheelPrev = task;
+	}
+	head = task;
+	++wheelSize;
+}
+
+void Scheduler::unlinkEvent(SchedulerTask* task)
+{
+	if (task->wheelPrev) {
+		task->wheelPrev->wheelNext = task->wheelNext;
+	} else {
+		*task->wheelSlot = task->wheelNext;
+	}
+
+	if (task->wheelNext) {
+		task->wheelNext->wheelPrev = task->wheelPrev;
+	}
+
+	task->wheelSlot = nullptr;
+	task->wheelPrev = nullptr;
+	task->wheelNext = nullptr;
+	--wheelSize;
+}
+
+void Scheduler::cascadeSlot(uint32_t slot)
+{
+	SchedulerTask* task = wheel[slot];
+	wheel[slot] = nullptr;
+
+	while (task) {
+		SchedulerTask* next = task->wheelNext;
+		task->wheelSlot = nullptr;
+		task->wheelPrev = nullptr;
+		task->wheelNext = nullptr;
+		--wheelSize;
+
+		scheduleEvent(task);
+		task = next;
+	}
+}
+
+void Scheduler::advanceWheel(uint64_t tick)
+{
+	while (currentTick < tick) {
+		if (wheelSize == 0) {
+			// nothing to cascade, skip the idle period at once
+			currentTick = tick;
+			break;
+		}
+
+		++currentTick;
+
+		if ((currentTick & (SCHEDULER_WHEEL_ROOT_SLOTS - 1)) == 0) {
+			uint32_t level = 1;
+			uint32_t shift = SCHEDULER_WHEEL_ROOT_BITS;
+			while (level < SCHEDULER_WHEEL_LEVELS - 1 && ((currentTick >> shift) & (SCHEDULER_WHEEL_LEVEL_SLOTS - 1)) == 0) {
+				++level;
+				shift += SCHEDULER_WHEEL_LEVEL_BITS;
+			}
+
+			// every level whose index wrapped around hands its next slot down,
+			// starting with the highest one
+			while (level > 0) {
+				cascadeSlot(SCHEDULER_WHEEL_ROOT_SLOTS + (level - 1) * SCHEDULER_WHEEL_LEVEL_SLOTS + ((currentTick >> shift) & (SCHEDULER_WHEEL_LEVEL_SLOTS - 1)));
+				--level;
+				shift -= SCHEDULER_WHEEL_LEVEL_BITS;
+			}
+		}
+
+		// moves the events of this tick to dueEvents
+		cascadeSlot(currentTick & (SCHEDULER_WHEEL_ROOT_SLOTS - 1));
+	}
+}
+
 uint32_t Scheduler::addEvent(SchedulerTask* task)
 {
 	bool do_signal = false;
@@ -87,27 +239,25 @@ uint32_t Scheduler::addEvent(SchedulerTask* task)
 		}
 
 		// insert the event id in the list of active events
-		eventIds.insert(task->getEventId());
-
-		// add the event to the queue
-		eventList.push(task);
+		activeEvents[task->getEventId()] = task;
 
-		// if the list was empty or this event is the top in the list
-		// we have to signal it
-		do_signal = (task == eventList.top());
+		// add the event to the wheel, signal the thread if it has to wake up
+		// earlier than it planned to
+		do_signal = scheduleEvent(task);
 	} else {
 		eventLock.unlock();
 		delete task;
 		return 0;
 	}
 
+	uint32_t eventId = task->getEventId();
 	eventLock.unlock();
 
 	if (do_signal) {
 		eventSignal.notify_one();
 	}
 
-	return task->getEventId();
+	return eventId;
 }
 
 bool Scheduler::stopEvent(uint32_t eventid)
@@ -116,15 +266,24 @@ bool Scheduler::stopEvent(uint32_t eventid)
 		return false;
 	}
 
-	std::lock_guard<std::mutex> lockGuard(eventLock);
+	std::unique_lock<std::mutex> eventLockUnique(eventLock);
 
 	// search the event id..
-	auto it = eventIds.find(eventid);
-	if (it == eventIds.end()) {
+	auto it = activeEvents.find(eventid);
+	if (it == activeEvents.end()) {
 		return false;
 	}
 
-	eventIds.erase(it);
+	SchedulerTask* task = it->second;
+	activeEvents.erase(it);
+
+	// events of the current tick are already in dueEvents and get dropped
+	// when they come up, everything else is removed right away
+	if (task->wheelSlot) {
+		unlinkEvent(task);
+		eventLockUnique.unlock();
+		delete task;
+	}
 	return true;
 }
 
@@ -141,12 +300,21 @@ void Scheduler::shutdown()
 	threadState = THREAD_STATE_TERMINATED;
 
 	//this list should already be empty
-	while (!eventList.empty()) {
-		delete eventList.top();
-		eventList.pop();
+	for (SchedulerTask*& head : wheel) {
+		while (head) {
+			SchedulerTask* task = head;
+			head = task->wheelNext;
+			delete task;
+		}
+	}
+	wheelSize = 0;
+
+	while (!dueEvents.empty()) {
+		delete dueEvents.top();
+		dueEvents.pop();
 	}
 
-	eventIds.clear();
+	activeEvents.clear();
 	eventLock.unlock();
 	eventSignal.notify_one();
 }
@@ -21,13 +21,28 @@
 #define FS_SCHEDULER_H_2905B3D5EAB34B4BA8830167262D2DC1
 
 #include "tasks.h"
-#include <unordered_set>
+#include <unordered_map>
 #include <queue>
 
 #include <condition_variable>
 
 #define SCHEDULER_MINTICKS 50
 
+// The scheduler keeps its events in a hierarchical timing wheel. Level 0 has
+// one slot per SCHEDULER_MINTICKS, every higher level covers a full turn of
+// the level below it per slot (~12.8 s, ~14 min, ~15 h, ~39 days).
+const uint32_t SCHEDULER_WHEEL_LEVELS = 4;
+const uint32_t SCHEDULER_WHEEL_ROOT_BITS = 8;
+const uint32_t SCHEDULER_WHEEL_LEVEL_BITS = 6;
+const uint32_t SCHEDULER_WHEEL_ROOT_SLOTS = 1 << SCHEDULER_WHEEL_ROOT_BITS;
+const uint32_t SCHEDULER_WHEEL_LEVEL_SLOTS = 1 << SCHEDULER_WHEEL_LEVEL_BITS;
+const uint32_t SCHEDULER_WHEEL_SLOTS = SCHEDULER_WHEEL_ROOT_SLOTS + (SCHEDULER_WHEEL_LEVELS - 1) * SCHEDULER_WHEEL_LEVEL_SLOTS;
+
+class SchedulerTask;
+
+template <typename F>
+SchedulerTask* createSchedulerTask(uint32_t delay, F&& f, TaskOrigin origin = TASK_ORIGIN_SCHEDULER);
+
 class SchedulerTask : public Task
 {
 	public:
@@ -42,19 +57,33 @@ class SchedulerTask : public Task
 			return expiration;
 		}
 
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
+
 	protected:
-		SchedulerTask(uint32_t delay, const std::function<void (void)>& f) : Task(delay, f) {
+		template <typename F>
+		SchedulerTask(uint32_t delay, F&& f, TaskOrigin origin) : Task(delay, std::forward<F>(f)) {
 			eventId = 0;
+			setOrigin(origin);
 		}
 
 		uint32_t eventId;
 
-		friend SchedulerTask* createSchedulerTask(uint32_t, const std::function<void (void)>&);
+		// intrusive links into a timing wheel slot, wheelSlot is nullptr
+		// while the task is not stored in the wheel
+		SchedulerTask** wheelSlot = nullptr;
+		SchedulerTask* wheelPrev = nullptr;
+		SchedulerTask* wheelNext = nullptr;
+
+		friend class Scheduler;
+		template <typename F>
+		friend SchedulerTask* createSchedulerTask(uint32_t, F&&, TaskOrigin);
 };
 
-inline SchedulerTask* createSchedulerTask(uint32_t delay, const std::function<void (void)>& f)
+template <typename F>
+inline SchedulerTask* createSchedulerTask(uint32_t delay, F&& f, TaskOrigin origin)
 {
-	return new SchedulerTask(std::max<uint32_t>(delay, SCHEDULER_MINTICKS), f);
+	return new SchedulerTask(std::max<uint32_t>(delay, SCHEDULER_MINTICKS), std::forward<F>(f), origin);
 }
 
 struct TaskComparator {
@@ -86,13 +115,31 @@ class Scheduler
 			return threadState.load(std::memory_order_relaxed);
 		}
 
+		// all of these must be called with eventLock held
+		uint64_t getTick(std::chrono::system_clock::time_point timePoint) const;
+		std::chrono::system_clock::time_point getTickTime(uint64_t tick) const;
+		bool scheduleEvent(SchedulerTask* task);
+		void linkEvent(SchedulerTask* task, uint64_t tick);
+		void unlinkEvent(SchedulerTask* task);
+		void cascadeSlot(uint32_t slot);
+		void advanceWheel(uint64_t tick);
+
 		std::thread thread;
 		std::mutex eventLock;
 		std::condition_variable eventSignal;
 
 		uint32_t lastEventId;
-		std::priority_queue<SchedulerTask*, std::deque<SchedulerTask*>, TaskComparator> eventList;
-		std::unordered_set<uint32_t> eventIds;
+		std::unordered_map<uint32_t, SchedulerTask*> activeEvents;
+
+		// wheel slots, level 0 first, then SCHEDULER_WHEEL_LEVEL_SLOTS per level
+		SchedulerTask* wheel[SCHEDULER_WHEEL_SLOTS] = {};
+		size_t wheelSize = 0;
+		std::chrono::system_clock::time_point wheelStart;
+		uint64_t currentTick = 0;
+
+		// events of the current tick, ordered by their exact cycle
+		std::priority_queue<SchedulerTask*, std::vector<SchedulerTask*>, TaskComparator> dueEvents;
+
 		std::atomic<ThreadState> threadState {THREAD_STATE_TERMINATED};
 };
 
@@ -30,7 +30,7 @@ extern ConfigManager g_config;
 Ban g_bans;
 
 ServiceManager::ServiceManager()
-	: m_io_service(), death_timer(m_io_service), running(false)
+	: m_io_service(), death_timer(m_io_service), m_nextConnectionService(0), running(false)
 {
 	//
 }
@@ -43,13 +43,49 @@ ServiceManager::~ServiceManager()
 void ServiceManager::die()
 {
 	m_io_service.stop();
+
+	m_connectionWork.clear();
+	for (const auto& service : m_connectionServices) {
+		service->stop();
+	}
 }
 
 void ServiceManager::run()
 {
 	assert(!running);
 	running = true;
+
+	for (const auto& service : m_connectionServices) {
+		boost::asio::io_service* io_service = service.get();
+		m_networkThreads.emplace_back([io_service]() {
+			io_service->run();
+		});
+	}
+
 	m_io_service.run();
+
+	for (std::thread& thread : m_networkThreads) {
+		thread.join();
+	}
+	m_networkThreads.clear();
+}
+
+void ServiceManager::setNetworkThreads(uint32_t count)
+{
+	assert(!running && m_connectionServices.empty());
+
+	for (uint32_t i = 0; i < count; ++i) {
+		m_connectionServices.emplace_back(new boost::asio::io_service(1));
+		m_connectionWork.emplace_back(new boost::asio::io_service::work(*m_connectionServices.back()));
+	}
+}
+
+boost::asio::io_service& ServiceManager::getConnectionService()
+{
+	if (m_connectionServices.empty()) {
+		return m_io_service;
+	}
+	return *m_connectionServices[m_nextConnectionService++ % m_connectionServices.size()];
 }
 
 void ServiceManager::stop()
@@ -77,8 +113,9 @@ void ServiceManager::stop()
 	death_timer.async_wait(std::bind(&ServiceManager::die, this));
 }
 
-ServicePort::ServicePort(boost::asio::io_service& io_service) :
+ServicePort::ServicePort(boost::asio::io_service& io_service, ServiceManager& serviceManager) :
 	m_io_service(io_service),
+	m_serviceManager(serviceManager),
 	m_acceptor(nullptr),
 	m_serverPort(0),
 	m_pendingStart(false)
@@ -117,11 +154,13 @@ void ServicePort::accept()
 		return;
 	}
 
-	boost::asio::ip::tcp::socket* socket = new boost::asio::ip::tcp::socket(m_io_service);
-	m_acceptor->async_accept(*socket, std::bind(&ServicePort::onAccept, this, socket, std::placeholders::_1));
+	// the socket already lives on the io_service that will run the connection
+	boost::asio::io_service& connectionService = m_serviceManager.getConnectionService();
+	boost::asio::ip::tcp::socket* socket = new boost::asio::ip::tcp::socket(connectionService);
+	m_acceptor->async_accept(*socket, std::bind(&ServicePort::onAccept, this, socket, &connectionService, std::placeholders::_1));
 }
 
-void ServicePort::onAccept(boost::asio::ip::tcp::socket* socket, const boost::system::error_code& error)
+void ServicePort::onAccept(boost::asio::ip::tcp::socket* socket, boost::asio::io_service* connectionService, const boost::system::error_code& error)
 {
 	if (!error) {
 		if (m_services.empty()) {
@@ -137,7 +176,7 @@ void ServicePort::onAccept(boost::asio::ip::tcp::socket* socket, const boost::sy
 		}
 
 		if (remote_ip != 0 && g_bans.acceptConnection(remote_ip)) {
-			Connection_ptr connection = ConnectionManager::getInstance()->createConnection(socket, m_io_service, shared_from_this());
+			Connection_ptr connection = ConnectionManager::getInstance()->createConnection(socket, *connectionService, shared_from_this());
 			Service_ptr service = m_services.front();
 			if (service->is_single_socket()) {
 				connection->accept(service->make_protocol(connection));
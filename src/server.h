@@ -23,6 +23,7 @@
 #include "connection.h"
 
 class Protocol;
+class ServiceManager;
 
 class ServiceBase
 {
@@ -60,7 +61,7 @@ class Service : public ServiceBase
 class ServicePort : public std::enable_shared_from_this<ServicePort>
 {
 	public:
-		explicit ServicePort(boost::asio::io_service& io_service);
+		ServicePort(boost::asio::io_service& io_service, ServiceManager& serviceManager);
 		~ServicePort();
 
 		// non-copyable
@@ -77,12 +78,13 @@ class ServicePort : public std::enable_shared_from_this<ServicePort>
 		Protocol* make_protocol(bool checksummed, NetworkMessage& msg) const;
 
 		void onStopServer();
-		void onAccept(boost::asio::ip::tcp::socket* socket, const boost::system::error_code& error);
+		void onAccept(boost::asio::ip::tcp::socket* socket, boost::asio::io_service* connectionService, const boost::system::error_code& error);
 
 	protected:
 		void accept();
 
 		boost::asio::io_service& m_io_service;
+		ServiceManager& m_serviceManager;
 		boost::asio::ip::tcp::acceptor* m_acceptor;
 		std::vector<Service_ptr> m_services;
 
@@ -103,6 +105,13 @@ class ServiceManager
 		void run();
 		void stop();
 
+		// Connections are spread over this many io_services with one thread
+		// each, a connection stays on the same one for its whole life so its
+		// handlers never run concurrently. Without them everything runs on
+		// the acceptor's io_service.
+		void setNetworkThreads(uint32_t count);
+		boost::asio::io_service& getConnectionService();
+
 		bool okay();
 
 		template <typename ProtocolType>
@@ -119,6 +128,12 @@ class ServiceManager
 
 		boost::asio::io_service m_io_service;
 		boost::asio::deadline_timer death_timer;
+
+		std::vector<std::unique_ptr<boost::asio::io_service>> m_connectionServices;
+		std::vector<std::unique_ptr<boost::asio::io_service::work>> m_connectionWork;
+		std::vector<std::thread> m_networkThreads;
+		std::atomic<uint32_t> m_nextConnectionService;
+
 		bool running;
 };
 
@@ -136,7 +151,7 @@ bool ServiceManager::add(uint16_t port)
 	    m_acceptors.find(port);
 
 	if (finder == m_acceptors.end()) {
-		service_port.reset(new ServicePort(m_io_service));
+		service_port.reset(new ServicePort(m_io_service, *this));
 		service_port->open(port);
 		m_acceptors[port] = service_port;
 	} else {
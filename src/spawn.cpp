@@ -106,7 +106,8 @@ bool Spawns::loadFromXml(const std::string& _filename)
 					continue;
 				}
 
-				Npc* npc = Npc::createNpc(nameAttribute.as_string());
+				const std::string name = nameAttribute.as_string();
+				Npc* npc = Npc::createNpc(name);
 				if (!npc) {
 					continue;
 				}
@@ -121,21 +122,130 @@ bool Spawns::loadFromXml(const std::string& _filename)
 					centerPos.y + pugi::cast<uint16_t>(childNode.attribute("y").value()),
 					centerPos.z
 				), radius);
-				npcList.push_front(npc);
+				npcList.push_front({npc, name});
 			}
 		}
 	}
 	return true;
 }
 
+static void writePosition(PropWriteStream& propWriteStream, const Position& pos)
+{
+	propWriteStream.write<uint16_t>(pos.x);
+	propWriteStream.write<uint16_t>(pos.y);
+	propWriteStream.write<uint8_t>(pos.z);
+}
+
+static bool readPosition(PropStream& propStream, Position& pos)
+{
+	return propStream.read<uint16_t>(pos.x) && propStream.read<uint16_t>(pos.y) && propStream.read<uint8_t>(pos.z);
+}
+
+void Spawns::serialize(PropWriteStream& propWriteStream) const
+{
+	// both lists are filled from the front, write them back to front so
+	// unserialize ends up with the same order
+	std::vector<const Spawn*> spawns;
+	for (const Spawn& spawn : spawnList) {
+		spawns.push_back(&spawn);
+	}
+
+	propWriteStream.write<uint32_t>(spawns.size());
+	for (auto it = spawns.rbegin(), end = spawns.rend(); it != end; ++it) {
+		(*it)->serialize(propWriteStream);
+	}
+
+	// the names are the ones the spawn file used, the monster and npc files
+	// may call the creatures differently
+	std::vector<const npcBlock_t*> npcs;
+	for (const npcBlock_t& nb : npcList) {
+		npcs.push_back(&nb);
+	}
+
+	propWriteStream.write<uint32_t>(npcs.size());
+	for (auto it = npcs.rbegin(), end = npcs.rend(); it != end; ++it) {
+		const Npc* npc = (*it)->npc;
+		propWriteStream.writeString((*it)->name);
+		writePosition(propWriteStream, npc->getMasterPos());
+		propWriteStream.write<int32_t>(npc->getMasterRadius());
+		propWriteStream.write<uint8_t>(npc->getDirection());
+	}
+}
+
+bool Spawns::unserialize(PropStream& propStream, const std::string& _filename)
+{
+	if (loaded) {
+		return true;
+	}
+
+	uint32_t spawnCount;
+	if (!propStream.read<uint32_t>(spawnCount)) {
+		return false;
+	}
+
+	filename = _filename;
+	loaded = true;
+
+	for (uint32_t i = 0; i < spawnCount; ++i) {
+		Position centerPos;
+		int32_t radius;
+		uint32_t monsterCount;
+		if (!readPosition(propStream, centerPos) || !propStream.read<int32_t>(radius) || !propStream.read<uint32_t>(monsterCount)) {
+			return false;
+		}
+
+		spawnList.emplace_front(centerPos, radius);
+		Spawn& spawn = spawnList.front();
+
+		for (uint32_t j = 0; j < monsterCount; ++j) {
+			std::string name;
+			Position pos;
+			uint8_t dir;
+			uint32_t interval;
+			if (!propStream.readString(name) || !readPosition(propStream, pos) || !propStream.read<uint8_t>(dir) || !propStream.read<uint32_t>(interval)) {
+				return false;
+			}
+
+			if (!spawn.addMonster(name, pos, static_cast<Direction>(dir), interval)) {
+				return false;
+			}
+		}
+	}
+
+	uint32_t npcCount;
+	if (!propStream.read<uint32_t>(npcCount)) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < npcCount; ++i) {
+		std::string name;
+		Position pos;
+		int32_t radius;
+		uint8_t dir;
+		if (!propStream.readString(name) || !readPosition(propStream, pos) || !propStream.read<int32_t>(radius) || !propStream.read<uint8_t>(dir)) {
+			return false;
+		}
+
+		Npc* npc = Npc::createNpc(name);
+		if (!npc) {
+			return false;
+		}
+
+		npc->setDirection(static_cast<Direction>(dir));
+		npc->setMasterPos(pos, radius);
+		npcList.push_front({npc, name});
+	}
+	return true;
+}
+
 void Spawns::startup()
 {
 	if (!loaded || isStarted()) {
 		return;
 	}
 
-	for (Npc* npc : npcList) {
-		g_game.placeCreature(npc, npc->getMasterPos(), false, true);
+	for (const npcBlock_t& nb : npcList) {
+		g_game.placeCreature(nb.npc, nb.npc->getMasterPos(), false, true);
 	}
 	npcList.clear();
 
@@ -153,6 +263,12 @@ void Spawns::clear()
 	}
 	spawnList.clear();
 
+	// npcs that were never placed
+	for (const npcBlock_t& nb : npcList) {
+		delete nb.npc;
+	}
+	npcList.clear();
+
 	loaded = false;
 	started = false;
 	filename.clear();
@@ -171,7 +287,7 @@ bool Spawns::isInZone(const Position& centerPos, int32_t radius, const Position&
 void Spawn::startSpawnCheck()
 {
 	if (checkSpawnEvent == 0) {
-		checkSpawnEvent = g_scheduler.addEvent(createSchedulerTask(getInterval(), std::bind(&Spawn::checkSpawn, this)));
+		checkSpawnEvent = g_scheduler.addEvent(createSchedulerTask(getInterval(), std::bind(&Spawn::checkSpawn, this), TASK_ORIGIN_SPAWN));
 	}
 }
 
@@ -264,7 +380,7 @@ void Spawn::checkSpawn()
 	}
 
 	if (spawnedMap.size() < spawnMap.size()) {
-		checkSpawnEvent = g_scheduler.addEvent(createSchedulerTask(getInterval(), std::bind(&Spawn::checkSpawn, this)));
+		checkSpawnEvent = g_scheduler.addEvent(createSchedulerTask(getInterval(), std::bind(&Spawn::checkSpawn, this), TASK_ORIGIN_SPAWN));
 	}
 }
 
@@ -290,6 +406,21 @@ void Spawn::cleanup()
 	}
 }
 
+void Spawn::serialize(PropWriteStream& propWriteStream) const
+{
+	writePosition(propWriteStream, centerPos);
+	propWriteStream.write<int32_t>(radius);
+
+	propWriteStream.write<uint32_t>(spawnMap.size());
+	for (const auto& it : spawnMap) {
+		const spawnBlock_t& sb = it.second;
+		propWriteStream.writeString(sb.name);
+		writePosition(propWriteStream, sb.pos);
+		propWriteStream.write<uint8_t>(sb.direction);
+		propWriteStream.write<uint32_t>(sb.interval);
+	}
+}
+
 bool Spawn::addMonster(const std::string& _name, const Position& _pos, Direction _dir, uint32_t _interval)
 {
 	MonsterType* mType = g_monsters.getMonsterType(_name);
@@ -304,6 +435,7 @@ bool Spawn::addMonster(const std::string& _name, const Position& _pos, Direction
 
 	spawnBlock_t sb;
 	sb.mType = mType;
+	sb.name = _name;
 	sb.pos = _pos;
 	sb.direction = _dir;
 	sb.interval = _interval;
@@ -30,11 +30,17 @@ class Npc;
 struct spawnBlock_t {
 	Position pos;
 	MonsterType* mType;
+	std::string name;
 	int64_t lastSpawn;
 	uint32_t interval;
 	Direction direction;
 };
 
+struct npcBlock_t {
+	Npc* npc;
+	std::string name;
+};
+
 class Spawn
 {
 	public:
@@ -59,6 +65,8 @@ class Spawn
 		bool isInSpawnZone(const Position& pos);
 		void cleanup();
 
+		void serialize(PropWriteStream& propWriteStream) const;
+
 	private:
 		//map of the spawned creatures
 		typedef std::multimap<uint32_t, Monster*> SpawnedMap;
@@ -87,6 +95,10 @@ class Spawns
 		static bool isInZone(const Position& centerPos, int32_t radius, const Position& pos);
 
 		bool loadFromXml(const std::string& _filename);
+
+		// the parsed spawn file as stored in the world cache
+		void serialize(PropWriteStream& propWriteStream) const;
+		bool unserialize(PropStream& propStream, const std::string& _filename);
 		void startup();
 		void clear();
 
@@ -95,7 +107,7 @@ class Spawns
 		}
 
 	private:
-		std::forward_list<Npc*> npcList;
+		std::forward_list<npcBlock_t> npcList;
 		std::forward_list<Spawn> spawnList;
 		std::string filename;
 		bool loaded, started;
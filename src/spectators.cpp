@@ -0,0 +1,93 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include "spectators.h"
+
+// pooled lists beyond this are freed instead of kept
+static const size_t SPECTATOR_BUFFER_POOL_SIZE = 16;
+
+SpectatorVec& SpectatorVec::operator=(const SpectatorVec& other)
+{
+	if (this != &other) {
+		count = 0;
+		reserve(other.count);
+		std::copy(other.begin(), other.end(), data);
+		count = other.count;
+	}
+	return *this;
+}
+
+void SpectatorVec::erase(Creature* creature)
+{
+	iterator it = std::find(begin(), end(), creature);
+	if (it != end()) {
+		std::move(it + 1, end(), it);
+		--count;
+	}
+}
+
+bool SpectatorVec::contains(const Creature* creature) const
+{
+	return std::find(begin(), end(), creature) != end();
+}
+
+void SpectatorVec::reserve(size_t newCapacity)
+{
+	if (newCapacity <= capacity) {
+		return;
+	}
+
+	Creature** newData = new Creature*[newCapacity];
+	std::copy(begin(), end(), newData);
+	if (data != inlineData) {
+		delete[] data;
+	}
+	data = newData;
+	capacity = newCapacity;
+}
+
+static std::vector<std::unique_ptr<SpectatorVec>>& getSpectatorBufferPool()
+{
+	static thread_local std::vector<std::unique_ptr<SpectatorVec>> pool;
+	return pool;
+}
+
+SpectatorBuffer::SpectatorBuffer()
+{
+	std::vector<std::unique_ptr<SpectatorVec>>& pool = getSpectatorBufferPool();
+	if (pool.empty()) {
+		list = new SpectatorVec;
+	} else {
+		list = pool.back().release();
+		pool.pop_back();
+	}
+}
+
+SpectatorBuffer::~SpectatorBuffer()
+{
+	std::vector<std::unique_ptr<SpectatorVec>>& pool = getSpectatorBufferPool();
+	if (pool.size() < SPECTATOR_BUFFER_POOL_SIZE) {
+		list->clear();
+		pool.emplace_back(list);
+	} else {
+		delete list;
+	}
+}
@@ -0,0 +1,123 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_SPECTATORS_H_BFF4BACE598D47A48B33CB7D2CAC5BAF
+#define FS_SPECTATORS_H_BFF4BACE598D47A48B33CB7D2CAC5BAF
+
+class Creature;
+
+// Contiguous list of creatures, each creature at most once. Up to
+// INLINE_CAPACITY creatures (a crowded screen) are stored without touching
+// the heap.
+class SpectatorVec
+{
+	public:
+		static const size_t INLINE_CAPACITY = 32;
+
+		typedef Creature** iterator;
+		typedef Creature* const* const_iterator;
+
+		SpectatorVec() : data(inlineData), count(0), capacity(INLINE_CAPACITY) {}
+		~SpectatorVec() {
+			if (data != inlineData) {
+				delete[] data;
+			}
+		}
+
+		SpectatorVec(const SpectatorVec& other) : SpectatorVec() {
+			*this = other;
+		}
+		SpectatorVec& operator=(const SpectatorVec& other);
+
+		// adds the creature unless it is in the list already
+		void insert(Creature* creature) {
+			if (!contains(creature)) {
+				push_back(creature);
+			}
+		}
+
+		// the caller guarantees the creature is not in the list yet
+		void push_back(Creature* creature) {
+			if (count == capacity) {
+				reserve(capacity * 2);
+			}
+			data[count++] = creature;
+		}
+
+		void erase(Creature* creature);
+		bool contains(const Creature* creature) const;
+
+		void reserve(size_t newCapacity);
+		void clear() {
+			count = 0;
+		}
+
+		size_t size() const {
+			return count;
+		}
+		bool empty() const {
+			return count == 0;
+		}
+
+		iterator begin() {
+			return data;
+		}
+		const_iterator begin() const {
+			return data;
+		}
+		iterator end() {
+			return data + count;
+		}
+		const_iterator end() const {
+			return data + count;
+		}
+
+	private:
+		Creature** data;
+		size_t count;
+		size_t capacity;
+		Creature* inlineData[INLINE_CAPACITY];
+};
+
+// Borrows an empty SpectatorVec from a pool owned by the calling thread and
+// hands it back on destruction. Lists that outgrew the inline storage keep
+// their heap buffer, so busy broadcast paths stop allocating after warmup.
+// Buffers nest, a callback may borrow another one while the outer one is in use.
+class SpectatorBuffer
+{
+	public:
+		SpectatorBuffer();
+		~SpectatorBuffer();
+
+		// non-copyable
+		SpectatorBuffer(const SpectatorBuffer&) = delete;
+		SpectatorBuffer& operator=(const SpectatorBuffer&) = delete;
+
+		SpectatorVec& operator*() {
+			return *list;
+		}
+		SpectatorVec* operator->() {
+			return list;
+		}
+
+	private:
+		SpectatorVec* list;
+};
+
+#endif
@@ -21,9 +21,26 @@
 
 #include "tasks.h"
 #include "outputmessage.h"
-#include "game.h"
+#include "taskstats.h"
 
-extern Game g_game;
+std::atomic<uint64_t> TaskFunc::heapAllocations {0};
+
+void* Task::operator new(size_t size)
+{
+	if (size != sizeof(Task)) {
+		return ::operator new(size);
+	}
+	return LockfreePoolingAllocator<Task, TASK_POOL_CAPACITY>::allocate();
+}
+
+void Task::operator delete(void* p, size_t size)
+{
+	if (size != sizeof(Task)) {
+		::operator delete(p);
+		return;
+	}
+	LockfreePoolingAllocator<Task, TASK_POOL_CAPACITY>::deallocate(p);
+}
 
 void Dispatcher::start()
 {
@@ -35,65 +52,189 @@ void Dispatcher::dispatcherThread()
 {
 	OutputMessagePool* outputPool = OutputMessagePool::getInstance();
 
-	// NOTE: second argument defer_lock is to prevent from immediate locking
-	std::unique_lock<std::mutex> taskLockUnique(taskLock, std::defer_lock);
+	std::vector<Task*> batch;
+	batch.reserve(DISPATCHER_BATCH_SIZE);
 
 	while (getState() != THREAD_STATE_TERMINATED) {
-		// check if there are tasks waiting
-		taskLockUnique.lock();
-
-		if (taskList.empty()) {
-			//if the list is empty wait for signal
-			taskSignal.wait(taskLockUnique);
+		if (tickInterval != 0) {
+			runTick(outputPool, batch);
+			continue;
 		}
 
-		if (!taskList.empty()) {
-			// take the first task
-			Task* task = taskList.front();
-			taskList.pop_front();
-			taskLockUnique.unlock();
+		g_taskStats.recordQueueDepth(getQueueDepth());
 
-			if (!task->hasExpired()) {
+		if (!popBatch(batch)) {
+			std::unique_lock<std::mutex> taskLockUnique(taskLock);
+			sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			// re-check after announcing that we're going to sleep, a producer
+			// that missed the flag has already published its task
+			if (!hasPendingTasks()) {
+				//if the queues are empty wait for signal
+				taskSignal.wait(taskLockUnique);
+			}
+			sleeping.store(false, std::memory_order_relaxed);
+			continue;
+		}
+
+		for (Task* task : batch) {
+			if (getState() != THREAD_STATE_TERMINATED && !task->hasExpired()) {
 				// execute it
 				outputPool->startExecutionFrame();
-				(*task)();
+				runTask(task);
 				outputPool->sendAll();
+			}
+			delete task;
+		}
+		batch.clear();
+	}
+}
 
-				g_game.map.clearSpectatorCache();
+void Dispatcher::runTick(OutputMessagePool* outputPool, std::vector<Task*>& batch)
+{
+	const auto interval = std::chrono::milliseconds(tickInterval);
+	auto now = std::chrono::steady_clock::now();
+	if (nextTick + interval < now) {
+		// first tick, or the tick mode was just switched on
+		nextTick = now;
+	}
+
+	g_taskStats.recordQueueDepth(getQueueDepth());
+
+	// sort everything that arrived since the last tick into its phase,
+	// tasks deferred by the previous tick stay in front
+	while (popBatch(batch)) {
+		for (Task* task : batch) {
+			phaseTasks[task->getPhase()].push_back(task);
+		}
+		batch.clear();
+	}
+
+	outputPool->startExecutionFrame();
+
+	for (uint8_t phase = 0; phase < TASK_PHASE_COUNT; ++phase) {
+		std::vector<Task*>& tasks = phaseTasks[phase];
+		const auto budgetEnd = std::chrono::steady_clock::now() + interval * TASK_PHASE_BUDGET[phase] / 100;
+
+		auto it = tasks.begin(), end = tasks.end();
+		while (it != end) {
+			Task* task = *it++;
+			if (getState() != THREAD_STATE_TERMINATED && !task->hasExpired()) {
+				runTask(task);
 			}
 			delete task;
-		} else {
-			taskLockUnique.unlock();
+
+			if (std::chrono::steady_clock::now() >= budgetEnd) {
+				break;
+			}
+		}
+
+		if (it != end) {
+			TaskPhaseStats& stats = phaseStats[phase];
+			++stats.overruns;
+			stats.deferredTasks += end - it;
 		}
+		tasks.erase(tasks.begin(), it);
+	}
+
+	// output flush, once per tick
+	outputPool->sendAll(true);
+
+	nextTick += interval;
+	now = std::chrono::steady_clock::now();
+	if (nextTick <= now) {
+		// don't try to catch up, just start the next tick right away
+		++tickOverruns;
+		nextTick = now;
+	} else {
+		std::this_thread::sleep_until(nextTick);
 	}
 }
 
-void Dispatcher::addTask(Task* task, bool push_front /*= false*/)
+void Dispatcher::runTask(Task* task)
 {
-	bool do_signal = false;
+	auto start = std::chrono::steady_clock::now();
+	(*task)();
+	auto end = std::chrono::steady_clock::now();
 
-	taskLock.lock();
+	g_taskStats.recordTask(*task,
+		std::chrono::duration_cast<std::chrono::microseconds>(start - task->getQueueTime()).count(),
+		std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
 
-	if (getState() == THREAD_STATE_RUNNING) {
-		do_signal = taskList.empty();
+size_t Dispatcher::getQueueDepth() const
+{
+	return priorityQueue.size() + taskQueue.size();
+}
+
+bool Dispatcher::hasPendingTasks() const
+{
+	return !priorityQueue.empty() || !taskQueue.empty() || overflowed.load(std::memory_order_acquire);
+}
+
+bool Dispatcher::popBatch(std::vector<Task*>& batch)
+{
+	Task* task;
+	while (batch.size() < DISPATCHER_BATCH_SIZE && priorityQueue.pop(task)) {
+		batch.push_back(task);
+	}
+
+	while (batch.size() < DISPATCHER_BATCH_SIZE && taskQueue.pop(task)) {
+		batch.push_back(task);
+	}
+
+	// only take the overflow once both lanes are drained, everything in
+	// there was pushed after the lanes filled up
+	if (batch.empty() && overflowed.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lockGuard(overflowLock);
+		batch.insert(batch.end(), overflowList.begin(), overflowList.end());
+		overflowList.clear();
+		overflowed.store(false, std::memory_order_release);
+	}
+	return !batch.empty();
+}
 
+void Dispatcher::enqueue(Task* task, bool push_front)
+{
+	task->setQueueTime(std::chrono::steady_clock::now());
+
+	bool pushed = false;
+	if (!overflowed.load(std::memory_order_acquire)) {
 		if (push_front) {
-			taskList.push_front(task);
+			pushed = priorityQueue.push(task);
 		} else {
-			taskList.push_back(task);
+			pushed = taskQueue.push(task);
 		}
-	} else {
-		delete task;
 	}
 
-	taskLock.unlock();
+	if (!pushed) {
+		std::lock_guard<std::mutex> lockGuard(overflowLock);
+		if (push_front) {
+			overflowList.push_front(task);
+		} else {
+			overflowList.push_back(task);
+		}
+		overflowed.store(true, std::memory_order_release);
+	}
 
-	// send a signal if the list was empty
-	if (do_signal) {
+	// pairs with the fence in dispatcherThread so a wakeup can't get lost
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lockGuard(taskLock);
 		taskSignal.notify_one();
 	}
 }
 
+void Dispatcher::addTask(Task* task, bool push_front /*= false*/)
+{
+	if (getState() == THREAD_STATE_RUNNING) {
+		enqueue(task, push_front);
+	} else {
+		delete task;
+	}
+}
+
 void Dispatcher::stop()
 {
 	setState(THREAD_STATE_CLOSING);
@@ -106,10 +247,7 @@ void Dispatcher::shutdown()
 		taskSignal.notify_one();
 	});
 
-	std::lock_guard<std::mutex> {taskLock};
-	taskList.push_back(task);
-
-	taskSignal.notify_one();
+	enqueue(task, false);
 }
 
 void Dispatcher::join()
@@ -24,19 +24,173 @@
 #include <atomic>
 
 #include "enums.h"
+#include "lockfree.h"
 
 const int DISPATCHER_TASK_EXPIRATION = 2000;
+const size_t DISPATCHER_QUEUE_CAPACITY = 65536;
+const size_t DISPATCHER_PRIORITY_QUEUE_CAPACITY = 4096;
+const size_t DISPATCHER_BATCH_SIZE = 128;
 const auto SYSTEM_TIME_ZERO = std::chrono::system_clock::time_point(std::chrono::milliseconds(0));
 
+const size_t TASK_POOL_CAPACITY = 16384;
+
+// Phases of a game tick, in the order they run when the dispatcher works in
+// fixed tick mode. In the default mode the phase is ignored.
+enum TaskPhase : uint8_t {
+	TASK_PHASE_NETWORK, // packets and connection events
+	TASK_PHASE_CREATURES, // Game::checkCreatures
+	TASK_PHASE_WALK, // creature walk steps
+	TASK_PHASE_DECAY, // Game::checkDecay
+	TASK_PHASE_EVENTS, // other scheduled events and scripts
+
+	TASK_PHASE_COUNT /* this must be the last one */
+};
+
+// share of the tick each phase may use before its remaining tasks are
+// deferred to the next tick, in percent
+const uint32_t TASK_PHASE_BUDGET[TASK_PHASE_COUNT] = {30, 30, 15, 10, 15};
+
+// Where a task comes from, used for the dispatcher statistics and to pick
+// the tick phase. Values up to TASK_ORIGIN_PACKET_LAST are game packet opcodes.
+enum TaskOrigin : uint16_t {
+	TASK_ORIGIN_PACKET_LAST = 0xFF,
+	TASK_ORIGIN_DISPATCHER, // untagged dispatcher task
+	TASK_ORIGIN_SCHEDULER, // untagged scheduler event
+	TASK_ORIGIN_CHECK_CREATURES,
+	TASK_ORIGIN_CREATURE_WALK,
+	TASK_ORIGIN_CHECK_DECAY,
+	TASK_ORIGIN_LUA_EVENT,
+	TASK_ORIGIN_GLOBAL_EVENT,
+	TASK_ORIGIN_SPAWN,
+	TASK_ORIGIN_RAID,
+	TASK_ORIGIN_PATHFINDER,
+	TASK_ORIGIN_MAP_CLEAN,
+
+	TASK_ORIGIN_COUNT /* this must be the last one */
+};
+
+inline TaskPhase getTaskOriginPhase(TaskOrigin origin)
+{
+	switch (origin) {
+		case TASK_ORIGIN_CHECK_CREATURES:
+		case TASK_ORIGIN_PATHFINDER: return TASK_PHASE_CREATURES;
+		case TASK_ORIGIN_CREATURE_WALK: return TASK_PHASE_WALK;
+		case TASK_ORIGIN_CHECK_DECAY: return TASK_PHASE_DECAY;
+		case TASK_ORIGIN_SCHEDULER:
+		case TASK_ORIGIN_LUA_EVENT:
+		case TASK_ORIGIN_GLOBAL_EVENT:
+		case TASK_ORIGIN_SPAWN:
+		case TASK_ORIGIN_RAID:
+		case TASK_ORIGIN_MAP_CLEAN: return TASK_PHASE_EVENTS;
+		default: return TASK_PHASE_NETWORK;
+	}
+}
+
+// Type-erased void() callable. Closures up to INLINE_SIZE bytes are stored
+// in place, only bigger ones are moved to the heap.
+class TaskFunc
+{
+	public:
+		static constexpr size_t INLINE_SIZE = 96;
+
+		template <typename F>
+		explicit TaskFunc(F&& f) {
+			assign(std::forward<F>(f));
+		}
+		~TaskFunc() {
+			ops->destroy(&storage);
+		}
+
+		// non-copyable
+		TaskFunc(const TaskFunc&) = delete;
+		TaskFunc& operator=(const TaskFunc&) = delete;
+
+		void operator()() {
+			ops->invoke(&storage);
+		}
+
+		// number of closures that did not fit into INLINE_SIZE so far
+		static uint64_t getHeapAllocations() {
+			return heapAllocations.load(std::memory_order_relaxed);
+		}
+
+	private:
+		using Storage = std::aligned_storage<INLINE_SIZE, alignof(std::max_align_t)>::type;
+
+		struct Ops {
+			void (*invoke)(void*);
+			void (*destroy)(void*);
+		};
+
+		template <typename T>
+		struct InlineOps {
+			static void invoke(void* p) {
+				(*static_cast<T*>(p))();
+			}
+			static void destroy(void* p) {
+				static_cast<T*>(p)->~T();
+			}
+		};
+
+		template <typename T>
+		struct HeapOps {
+			static void invoke(void* p) {
+				(**static_cast<T**>(p))();
+			}
+			static void destroy(void* p) {
+				delete *static_cast<T**>(p);
+			}
+		};
+
+		template <typename F>
+		void assign(F&& f) {
+			using T = typename std::decay<F>::type;
+			assign(std::forward<F>(f), std::integral_constant<bool, sizeof(T) <= INLINE_SIZE && alignof(T) <= alignof(Storage)>());
+		}
+
+		template <typename F>
+		void assign(F&& f, std::true_type) {
+			using T = typename std::decay<F>::type;
+			static const Ops inlineOps = {&InlineOps<T>::invoke, &InlineOps<T>::destroy};
+			new (&storage) T(std::forward<F>(f));
+			ops = &inlineOps;
+		}
+
+		template <typename F>
+		void assign(F&& f, std::false_type) {
+			using T = typename std::decay<F>::type;
+			static const Ops heapOps = {&HeapOps<T>::invoke, &HeapOps<T>::destroy};
+			*reinterpret_cast<T**>(&storage) = new T(std::forward<F>(f));
+			ops = &heapOps;
+			heapAllocations.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		const Ops* ops;
+		Storage storage;
+
+		static std::atomic<uint64_t> heapAllocations;
+};
+
 class Task
 {
 	public:
 		// DO NOT allocate this class on the stack
-		Task(uint32_t ms, const std::function<void (void)>& f) : func(f) {
+		template <typename F>
+		Task(uint32_t ms, F&& f) : func(std::forward<F>(f)) {
 			expiration = std::chrono::system_clock::now() + std::chrono::milliseconds(ms);
 		}
-		explicit Task(const std::function<void (void)>& f)
-			: expiration(SYSTEM_TIME_ZERO), func(f) {}
+		template <typename F>
+		explicit Task(F&& f)
+			: expiration(SYSTEM_TIME_ZERO), func(std::forward<F>(f)) {}
+		virtual ~Task() = default;
+
+		// non-copyable
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+
+		// tasks are recycled through a lock-free free list
+		static void* operator new(size_t size);
+		static void operator delete(void* p, size_t size);
 
 		void operator()() {
 			func();
@@ -53,29 +207,82 @@ class Task
 			return expiration < std::chrono::system_clock::now();
 		}
 
+		TaskOrigin getOrigin() const {
+			return origin;
+		}
+		void setOrigin(TaskOrigin newOrigin) {
+			origin = newOrigin;
+		}
+		TaskPhase getPhase() const {
+			return getTaskOriginPhase(origin);
+		}
+
+		// statistics, set by the dispatcher and scheduler
+		void setQueueTime(std::chrono::steady_clock::time_point time) {
+			queueTime = time;
+		}
+		std::chrono::steady_clock::time_point getQueueTime() const {
+			return queueTime;
+		}
+		void setLateness(int64_t microseconds) {
+			lateness = microseconds;
+		}
+		int64_t getLateness() const {
+			return lateness;
+		}
+
 	protected:
 		// Expiration has another meaning for scheduler tasks,
 		// then it is the time the task should be added to the
 		// dispatcher
 		std::chrono::system_clock::time_point expiration;
-		std::function<void (void)> func;
+		TaskFunc func;
+		TaskOrigin origin = TASK_ORIGIN_DISPATCHER;
+
+		std::chrono::steady_clock::time_point queueTime;
+		int64_t lateness = -1; // microseconds, only for scheduler events
 };
 
-inline Task* createTask(const std::function<void (void)>& f)
+template <typename F>
+inline Task* createTask(F&& f)
 {
-	return new Task(f);
+	return new Task(std::forward<F>(f));
 }
 
-inline Task* createTask(uint32_t expiration, const std::function<void (void)>& f)
+template <typename F>
+inline Task* createTask(uint32_t expiration, F&& f)
 {
-	return new Task(expiration, f);
+	return new Task(expiration, std::forward<F>(f));
 }
 
+struct TaskPhaseStats {
+	uint64_t overruns = 0;
+	uint64_t deferredTasks = 0;
+};
+
+class OutputMessagePool;
+
 class Dispatcher
 {
 	public:
 		void addTask(Task* task, bool push_front = false);
 
+		// 0 runs every task as soon as it arrives, anything else switches to
+		// fixed ticks of that many milliseconds. Dispatcher thread only.
+		void setTickInterval(uint32_t interval) {
+			tickInterval = interval;
+		}
+		uint32_t getTickInterval() const {
+			return tickInterval;
+		}
+
+		uint64_t getTickOverruns() const {
+			return tickOverruns;
+		}
+		const TaskPhaseStats& getPhaseStats(TaskPhase phase) const {
+			return phaseStats[phase];
+		}
+
 		void start();
 		void stop();
 		void shutdown();
@@ -83,6 +290,12 @@ class Dispatcher
 
 	protected:
 		void dispatcherThread();
+		void runTick(OutputMessagePool* outputPool, std::vector<Task*>& batch);
+		void runTask(Task* task);
+		size_t getQueueDepth() const;
+		void enqueue(Task* task, bool push_front);
+		bool popBatch(std::vector<Task*>& batch);
+		bool hasPendingTasks() const;
 		void setState(ThreadState newState) {
 			threadState.store(newState, std::memory_order_relaxed);
 		}
@@ -92,10 +305,31 @@ class Dispatcher
 		}
 
 		std::thread thread;
+
+		// producers push into the lock-free lanes, taskLock is only taken to
+		// put the dispatcher thread to sleep or to wake it up
 		std::mutex taskLock;
 		std::condition_variable taskSignal;
+		std::atomic<bool> sleeping {false};
+
+		// push_front tasks (scheduler events) go through their own lane,
+		// which is always drained before the regular one
+		LockfreeBoundedQueue<Task*, DISPATCHER_PRIORITY_QUEUE_CAPACITY> priorityQueue;
+		LockfreeBoundedQueue<Task*, DISPATCHER_QUEUE_CAPACITY> taskQueue;
+
+		// used when a lane is full; once something has overflowed, every
+		// new task goes here as well until it is drained to keep FIFO order
+		std::mutex overflowLock;
+		std::list<Task*> overflowList;
+		std::atomic<bool> overflowed {false};
+
+		// fixed tick mode, only touched by the dispatcher thread
+		uint32_t tickInterval = 0;
+		std::chrono::steady_clock::time_point nextTick;
+		std::vector<Task*> phaseTasks[TASK_PHASE_COUNT];
+		TaskPhaseStats phaseStats[TASK_PHASE_COUNT];
+		uint64_t tickOverruns = 0;
 
-		std::list<Task*> taskList;
 		std::atomic<ThreadState> threadState {THREAD_STATE_TERMINATED};
 };
 
@@ -0,0 +1,214 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include <fstream>
+
+#include "taskstats.h"
+#include "scheduler.h"
+#include "tools.h"
+
+extern Dispatcher g_dispatcher;
+extern Scheduler g_scheduler;
+
+static const char* TASK_PHASE_NAMES[TASK_PHASE_COUNT] = {"network", "creatures", "walk", "decay", "events"};
+
+static std::string getTaskOriginName(uint16_t origin)
+{
+	if (origin <= TASK_ORIGIN_PACKET_LAST) {
+		std::ostringstream ss;
+		ss << "packet 0x" << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << origin;
+		return ss.str();
+	}
+
+	switch (origin) {
+		case TASK_ORIGIN_DISPATCHER: return "dispatcher";
+		case TASK_ORIGIN_SCHEDULER: return "scheduler";
+		case TASK_ORIGIN_CHECK_CREATURES: return "checkCreatures";
+		case TASK_ORIGIN_CREATURE_WALK: return "creatureWalk";
+		case TASK_ORIGIN_CHECK_DECAY: return "checkDecay";
+		case TASK_ORIGIN_LUA_EVENT: return "addEvent";
+		case TASK_ORIGIN_GLOBAL_EVENT: return "globalEvent";
+		case TASK_ORIGIN_SPAWN: return "spawn";
+		case TASK_ORIGIN_RAID: return "raid";
+		case TASK_ORIGIN_PATHFINDER: return "pathfinder";
+		case TASK_ORIGIN_MAP_CLEAN: return "mapClean";
+		default: return "unknown";
+	}
+}
+
+// Histogram
+
+uint32_t Histogram::getBucket(uint64_t value)
+{
+	if (value < SUB_BUCKETS) {
+		return static_cast<uint32_t>(value);
+	}
+
+	value = std::min<uint64_t>(value, std::numeric_limits<uint32_t>::max());
+
+	uint32_t exponent = SUB_BUCKET_BITS;
+	while ((value >> (exponent + 1)) != 0) {
+		++exponent;
+	}
+
+	uint32_t subBucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+	return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+}
+
+uint64_t Histogram::getBucketLimit(uint32_t bucket)
+{
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+
+	uint32_t exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+	uint64_t subBucket = bucket % SUB_BUCKETS;
+	uint32_t shift = exponent - SUB_BUCKET_BITS;
+	return ((SUB_BUCKETS + subBucket + 1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value)
+{
+	++buckets[getBucket(value)];
+	++count;
+	total += value;
+	max = std::max(max, value);
+}
+
+void Histogram::reset()
+{
+	std::fill(std::begin(buckets), std::end(buckets), 0);
+	count = 0;
+	total = 0;
+	max = 0;
+}
+
+uint64_t Histogram::getPercentile(double percentile) const
+{
+	if (count == 0) {
+		return 0;
+	}
+
+	uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(count * percentile / 100.0 + 0.5));
+	uint64_t seen = 0;
+	for (uint32_t bucket = 0; bucket < BUCKETS; ++bucket) {
+		seen += buckets[bucket];
+		if (seen >= target) {
+			return std::min(getBucketLimit(bucket), max);
+		}
+	}
+	return max;
+}
+
+// TaskStats
+
+void TaskStats::recordTask(const Task& task, int64_t waitTime, int64_t executionTime)
+{
+	std::unique_ptr<TaskOriginStats>& stats = origins[task.getOrigin()];
+	if (!stats) {
+		stats.reset(new TaskOriginStats);
+	}
+
+	stats->wait.record(std::max<int64_t>(0, waitTime));
+	stats->execution.record(std::max<int64_t>(0, executionTime));
+
+	int64_t lateness = task.getLateness();
+	if (lateness >= 0) {
+		stats->lateness.record(lateness);
+	}
+}
+
+void TaskStats::reset()
+{
+	for (std::unique_ptr<TaskOriginStats>& stats : origins) {
+		stats.reset();
+	}
+	queueDepth.reset();
+	since = std::chrono::system_clock::now();
+}
+
+static void writeHistogram(std::ostringstream& ss, const char* name, const Histogram& histogram)
+{
+	ss << ' ' << name << ' ' << histogram.getPercentile(50) << '/' << histogram.getPercentile(99) << '/' << histogram.getMax();
+}
+
+std::string TaskStats::getReport() const
+{
+	std::vector<std::pair<uint16_t, const TaskOriginStats*>> sorted;
+	for (uint16_t origin = 0; origin < TASK_ORIGIN_COUNT; ++origin) {
+		if (origins[origin]) {
+			sorted.emplace_back(origin, origins[origin].get());
+		}
+	}
+
+	// the origins that take up most of the dispatcher first
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<uint16_t, const TaskOriginStats*>& lhs, const std::pair<uint16_t, const TaskOriginStats*>& rhs) {
+		return lhs.second->execution.getTotal() > rhs.second->execution.getTotal();
+	});
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now() - since).count();
+
+	std::ostringstream ss;
+	ss << "Task statistics for the last " << elapsed << " seconds (p50/p99/max in microseconds)" << std::endl;
+	ss << "Queue depth";
+	writeHistogram(ss, "tasks", queueDepth);
+	ss << ", closures on the heap " << TaskFunc::getHeapAllocations() << std::endl;
+
+	if (g_dispatcher.getTickInterval() != 0) {
+		ss << "Tick " << g_dispatcher.getTickInterval() << " ms, overruns " << g_dispatcher.getTickOverruns();
+		for (uint8_t phase = 0; phase < TASK_PHASE_COUNT; ++phase) {
+			const TaskPhaseStats& phaseStats = g_dispatcher.getPhaseStats(static_cast<TaskPhase>(phase));
+			ss << ", " << TASK_PHASE_NAMES[phase] << ' ' << phaseStats.overruns << " (" << phaseStats.deferredTasks << " deferred)";
+		}
+		ss << std::endl;
+	}
+
+	for (const auto& entry : sorted) {
+		const TaskOriginStats& stats = *entry.second;
+		ss << getTaskOriginName(entry.first) << ": " << stats.execution.getCount() << " tasks, " << stats.execution.getTotal() / 1000 << " ms total,";
+		writeHistogram(ss, "exec", stats.execution);
+		writeHistogram(ss, "wait", stats.wait);
+		if (stats.lateness.getCount() != 0) {
+			writeHistogram(ss, "late", stats.lateness);
+		}
+		ss << std::endl;
+	}
+	return ss.str();
+}
+
+void TaskStats::startLogging(uint32_t interval)
+{
+	logInterval = interval;
+	if (logInterval != 0) {
+		g_scheduler.addEvent(createSchedulerTask(logInterval * 1000, std::bind(&TaskStats::writeLog, this)));
+	}
+}
+
+void TaskStats::writeLog()
+{
+	std::ofstream out("data/logs/taskstats.log", std::ios::app);
+	if (out.is_open()) {
+		out << "[" << formatDate(time(nullptr)) << "]" << std::endl << getReport() << std::endl;
+	}
+
+	reset();
+	g_scheduler.addEvent(createSchedulerTask(logInterval * 1000, std::bind(&TaskStats::writeLog, this)));
+}
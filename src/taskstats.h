@@ -0,0 +1,96 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_TASKSTATS_H_3F0E5C14B9D74E6A8E2A1C56D7F09B42
+#define FS_TASKSTATS_H_3F0E5C14B9D74E6A8E2A1C56D7F09B42
+
+#include "tasks.h"
+
+// Log-linear histogram in the spirit of HdrHistogram: every power of two is
+// split into SUB_BUCKETS linear buckets, so a recorded value is off by at
+// most 1/SUB_BUCKETS. Values are clamped to 32 bits.
+class Histogram
+{
+	public:
+		static constexpr uint32_t SUB_BUCKET_BITS = 4;
+		static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		static constexpr uint32_t BUCKETS = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+		void record(uint64_t value);
+		void reset();
+
+		uint64_t getCount() const {
+			return count;
+		}
+		uint64_t getTotal() const {
+			return total;
+		}
+		uint64_t getMax() const {
+			return max;
+		}
+		uint64_t getMean() const {
+			return count != 0 ? total / count : 0;
+		}
+
+		// upper bound of the bucket holding the given percentile (0 - 100)
+		uint64_t getPercentile(double percentile) const;
+
+	private:
+		static uint32_t getBucket(uint64_t value);
+		static uint64_t getBucketLimit(uint32_t bucket);
+
+		uint64_t buckets[BUCKETS] = {};
+		uint64_t count = 0;
+		uint64_t total = 0;
+		uint64_t max = 0;
+};
+
+struct TaskOriginStats {
+	Histogram wait; // time spent in the dispatcher queue
+	Histogram execution;
+	Histogram lateness; // scheduler events only, firing time - cycle
+};
+
+// Dispatcher thread only, all times in microseconds.
+class TaskStats
+{
+	public:
+		void recordTask(const Task& task, int64_t waitTime, int64_t executionTime);
+		void recordQueueDepth(uint64_t depth) {
+			queueDepth.record(depth);
+		}
+
+		void reset();
+		std::string getReport() const;
+
+		// appends the report to data/logs/taskstats.log every interval seconds
+		void startLogging(uint32_t interval);
+
+	private:
+		void writeLog();
+
+		std::unique_ptr<TaskOriginStats> origins[TASK_ORIGIN_COUNT];
+		Histogram queueDepth;
+		std::chrono::system_clock::time_point since = std::chrono::system_clock::now();
+		uint32_t logInterval = 0;
+};
+
+extern TaskStats g_taskStats;
+
+#endif
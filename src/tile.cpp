@@ -802,7 +802,6 @@ void Tile::addThing(int32_t, Thing* thing)
 {
 	Creature* creature = thing->getCreature();
 	if (creature) {
-		g_game.map.clearSpectatorCache();
 		creature->setParent(this);
 		CreatureVector* creatures = makeCreatures();
 		creatures->insert(creatures->begin(), creature);
@@ -1007,7 +1006,6 @@ void Tile::removeThing(Thing* thing, uint32_t count)
 		if (creatures) {
 			CreatureVector::iterator it = std::find(creatures->begin(), creatures->end(), thing);
 			if (it != creatures->end()) {
-				g_game.map.clearSpectatorCache();
 				creatures->erase(it);
 			}
 		}
@@ -1090,8 +1088,9 @@ void Tile::removeThing(Thing* thing, uint32_t count)
 
 void Tile::removeCreature(Creature* creature)
 {
-	g_game.map.getQTNode(tilePos.x, tilePos.y)->removeCreature(creature);
+	g_game.map.getQTNode(tilePos.x, tilePos.y)->removeCreature(creature, tilePos.z);
 	removeThing(creature, 0);
+	g_game.map.updateSpectatorCache(*creature, &tilePos, nullptr);
 }
 
 int32_t Tile::getThingIndex(const Thing* thing) const
@@ -1405,7 +1404,6 @@ void Tile::internalAddThing(uint32_t, Thing* thing)
 
 	Creature* creature = thing->getCreature();
 	if (creature) {
-		g_game.map.clearSpectatorCache();
 		CreatureVector* creatures = makeCreatures();
 		creatures->insert(creatures->begin(), creature);
 	} else {
@@ -1538,6 +1536,8 @@ void Tile::setTileFlags(const Item* item)
 	if (item->hasProperty(CONST_PROP_SUPPORTHANGABLE)) {
 		setFlag(TILESTATE_SUPPORTS_HANGABLE);
 	}
+
+	g_game.map.updateWalkability(this);
 }
 
 void Tile::resetTileFlags(const Item* item)
@@ -1630,6 +1630,8 @@ void Tile::resetTileFlags(const Item* item)
 	if (item->hasProperty(CONST_PROP_SUPPORTHANGABLE)) {
 		resetFlag(TILESTATE_SUPPORTS_HANGABLE);
 	}
+
+	g_game.map.updateWalkability(this);
 }
 
 bool Tile::isMoveableBlocking() const
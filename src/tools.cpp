@@ -21,6 +21,7 @@
 
 #include "tools.h"
 #include "configmanager.h"
+#include "packetcrypto.h"
 
 extern ConfigManager g_config;
 
@@ -781,24 +782,7 @@ uint32_t adlerChecksum(const uint8_t* data, size_t length)
 		return 0;
 	}
 
-	const uint16_t adler = 65521;
-
-	uint32_t a = 1, b = 0;
-
-	while (length > 0) {
-		size_t tmp = length > 5552 ? 5552 : length;
-		length -= tmp;
-
-		do {
-			a += *data++;
-			b += a;
-		} while (--tmp);
-
-		a %= adler;
-		b %= adler;
-	}
-
-	return (b << 16) | a;
+	return adler32(data, length);
 }
 
 std::string ucfirst(std::string str)
@@ -0,0 +1,90 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include "walkability.h"
+
+void WalkabilityMap::setFlags(uint16_t x, uint16_t y, uint8_t z, uint16_t flags)
+{
+	if (z >= WALKABILITY_MAX_LAYERS) {
+		return;
+	}
+
+	uint32_t chunkX = x >> WALKABILITY_CHUNK_BITS;
+	uint32_t chunkY = y >> WALKABILITY_CHUNK_BITS;
+	if (chunkX >= chunksX || chunkY >= chunksY) {
+		uint32_t newChunksX = std::min<uint32_t>(std::max(chunkX + 1, chunksX * 2), 0x10000 >> WALKABILITY_CHUNK_BITS);
+		uint32_t newChunksY = std::min<uint32_t>(std::max(chunkY + 1, chunksY * 2), 0x10000 >> WALKABILITY_CHUNK_BITS);
+
+		for (std::vector<std::unique_ptr<Chunk>>& floorChunks : chunks) {
+			std::vector<std::unique_ptr<Chunk>> newFloorChunks(newChunksX * newChunksY);
+			for (uint32_t cy = 0; cy < chunksY; ++cy) {
+				for (uint32_t cx = 0; cx < chunksX; ++cx) {
+					newFloorChunks[cy * newChunksX + cx] = std::move(floorChunks[cy * chunksX + cx]);
+				}
+			}
+			floorChunks.swap(newFloorChunks);
+		}
+
+		chunksX = newChunksX;
+		chunksY = newChunksY;
+	}
+
+	std::unique_ptr<Chunk>& chunk = chunks[z][chunkY * chunksX + chunkX];
+	if (!chunk) {
+		chunk.reset(new Chunk);
+	}
+	chunk->flags[x & WALKABILITY_CHUNK_MASK][y & WALKABILITY_CHUNK_MASK] = flags;
+}
+
+uint32_t WalkabilityMap::getGeneration(uint16_t fromX, uint16_t fromY, uint16_t toX, uint16_t toY, uint8_t z) const
+{
+	if (z >= WALKABILITY_MAX_LAYERS) {
+		return 0;
+	}
+
+	const uint32_t endX = toX >> WALKABILITY_CHUNK_BITS;
+	const uint32_t endY = toY >> WALKABILITY_CHUNK_BITS;
+
+	uint32_t generation = 0;
+	for (uint32_t chunkY = fromY >> WALKABILITY_CHUNK_BITS; chunkY <= endY && chunkY < chunksY; ++chunkY) {
+		for (uint32_t chunkX = fromX >> WALKABILITY_CHUNK_BITS; chunkX <= endX && chunkX < chunksX; ++chunkX) {
+			const Chunk* chunk = chunks[z][chunkY * chunksX + chunkX].get();
+			if (chunk) {
+				generation = std::max(generation, chunk->generation);
+			}
+		}
+	}
+	return generation;
+}
+
+void WalkabilityMap::setGeneration(uint16_t x, uint16_t y, uint8_t z, uint32_t generation)
+{
+	uint32_t chunkX = x >> WALKABILITY_CHUNK_BITS;
+	uint32_t chunkY = y >> WALKABILITY_CHUNK_BITS;
+	if (z >= WALKABILITY_MAX_LAYERS || chunkX >= chunksX || chunkY >= chunksY) {
+		return;
+	}
+
+	Chunk* chunk = chunks[z][chunkY * chunksX + chunkX].get();
+	if (chunk) {
+		chunk->generation = generation;
+	}
+}
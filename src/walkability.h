@@ -0,0 +1,134 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_WALKABILITY_H_C0D701A3E808427495A96170F56211BA
+#define FS_WALKABILITY_H_C0D701A3E808427495A96170F56211BA
+
+#include "position.h"
+
+#define WALKABILITY_CHUNK_BITS 5
+#define WALKABILITY_CHUNK_SIZE (1 << WALKABILITY_CHUNK_BITS)
+#define WALKABILITY_CHUNK_MASK (WALKABILITY_CHUNK_SIZE - 1)
+#define WALKABILITY_MAX_LAYERS 16
+
+enum WalkabilityFlags_t : uint16_t {
+	WALKABILITY_NONE = 0, // no tile
+
+	WALKABILITY_DIRTY = 1 << 0, // the tile changed, flags have to be read from it again
+	WALKABILITY_GROUND = 1 << 1,
+	WALKABILITY_BLOCKSOLID = 1 << 2,
+	WALKABILITY_BLOCKPATH = 1 << 3,
+	WALKABILITY_BLOCKPROJECTILE = 1 << 4,
+	WALKABILITY_PROTECTIONZONE = 1 << 5,
+	WALKABILITY_FLOORCHANGE = 1 << 6, // floor change or teleport
+	WALKABILITY_IMMOVABLEBLOCKSOLID = 1 << 7,
+	WALKABILITY_IMMOVABLENOFIELDBLOCKPATH = 1 << 8,
+	WALKABILITY_NOFIELDBLOCKPATH = 1 << 9,
+	WALKABILITY_MAGICFIELD = 1 << 10,
+	WALKABILITY_HOUSE = 1 << 11,
+};
+
+// Creatures that are blocked by the same walkability flags, see Map::isPathBlocked
+enum PathClass_t : uint8_t {
+	PATHCLASS_CREATURE,
+	PATHCLASS_MONSTER,
+	PATHCLASS_MONSTER_PUSHITEMS,
+
+	PATHCLASS_LAST = PATHCLASS_MONSTER_PUSHITEMS
+};
+
+// Steps from start towards destination on the floor of start the way the
+// sight checks do, stops at the first position isBlocked returns true for.
+// \returns the position it stopped at
+template <typename IsBlocked>
+Position walkSightLine(Position start, const Position& destination, IsBlocked isBlocked)
+{
+	const int8_t mx = start.x < destination.x ? 1 : start.x == destination.x ? 0 : -1;
+	const int8_t my = start.y < destination.y ? 1 : start.y == destination.y ? 0 : -1;
+
+	int32_t A = Position::getOffsetY(destination, start);
+	int32_t B = Position::getOffsetX(start, destination);
+	int32_t C = -(A * destination.x + B * destination.y);
+
+	while (start.x != destination.x || start.y != destination.y) {
+		int32_t move_hor = std::abs(A * (start.x + mx) + B * (start.y) + C);
+		int32_t move_ver = std::abs(A * (start.x) + B * (start.y + my) + C);
+		int32_t move_cross = std::abs(A * (start.x + mx) + B * (start.y + my) + C);
+
+		if (start.y != destination.y && (start.x == destination.x || move_hor > move_ver || move_hor > move_cross)) {
+			start.y += my;
+		}
+
+		if (start.x != destination.x && (start.y == destination.y || move_ver > move_hor || move_ver > move_cross)) {
+			start.x += mx;
+		}
+
+		if (isBlocked(start)) {
+			break;
+		}
+	}
+	return start;
+}
+
+// Packed copy of the tile properties that pathfinding and sight checks ask
+// for, stored per position in 32x32 blocks so lookups do not need the tile.
+// Map::setTile marks new tiles dirty and their flags are read on the next
+// lookup, later item changes update them through Map::updateWalkability.
+class WalkabilityMap
+{
+	public:
+		WalkabilityMap() : chunksX(0), chunksY(0) {}
+
+		uint16_t getFlags(uint16_t x, uint16_t y, uint8_t z) const {
+			uint32_t chunkX = x >> WALKABILITY_CHUNK_BITS;
+			uint32_t chunkY = y >> WALKABILITY_CHUNK_BITS;
+			if (z >= WALKABILITY_MAX_LAYERS || chunkX >= chunksX || chunkY >= chunksY) {
+				return WALKABILITY_NONE;
+			}
+
+			const Chunk* chunk = chunks[z][chunkY * chunksX + chunkX].get();
+			if (!chunk) {
+				return WALKABILITY_NONE;
+			}
+			return chunk->flags[x & WALKABILITY_CHUNK_MASK][y & WALKABILITY_CHUNK_MASK];
+		}
+
+		void setFlags(uint16_t x, uint16_t y, uint8_t z, uint16_t flags);
+		void markDirty(uint16_t x, uint16_t y, uint8_t z) {
+			setFlags(x, y, z, getFlags(x, y, z) | WALKABILITY_DIRTY);
+		}
+
+		// Generation stamps of the chunks, Map uses them to tell which
+		// memoized sight checks saw a chunk before a projectile blocker
+		// in it changed. Chunks that were never stamped are 0.
+		uint32_t getGeneration(uint16_t fromX, uint16_t fromY, uint16_t toX, uint16_t toY, uint8_t z) const;
+		void setGeneration(uint16_t x, uint16_t y, uint8_t z, uint32_t generation);
+
+	private:
+		struct Chunk {
+			Chunk() : flags(), generation(0) {}
+			uint16_t flags[WALKABILITY_CHUNK_SIZE][WALKABILITY_CHUNK_SIZE];
+			uint32_t generation;
+		};
+
+		std::vector<std::unique_ptr<Chunk>> chunks[WALKABILITY_MAX_LAYERS];
+		uint32_t chunksX, chunksY;
+};
+
+#endif
@@ -0,0 +1,510 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "otpch.h"
+
+#include <fstream>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "worldcache.h"
+#include "iomap.h"
+#include "map.h"
+#include "container.h"
+#include "depotlocker.h"
+#include "housetile.h"
+#include "town.h"
+
+static const uint32_t WORLD_CACHE_MAGIC = 0x43574654; // "TFWC"
+static const uint64_t HASH_OFFSET_BASIS = 14695981039346656037ULL;
+
+static uint64_t hashBytes(const char* data, size_t size, uint64_t hash = HASH_OFFSET_BASIS)
+{
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static uint64_t hashFile(const std::string& filename)
+{
+	try {
+		boost::iostreams::mapped_file_source file(filename);
+		return hashBytes(file.data(), file.size());
+	} catch (const std::exception&) {
+		return 0;
+	}
+}
+
+static std::string getCachePath(const std::string& identifier)
+{
+	return identifier.substr(0, identifier.rfind('.')) + ".cache";
+}
+
+static void writePosition(PropWriteStream& stream, const Position& pos)
+{
+	stream.write<uint16_t>(pos.x);
+	stream.write<uint16_t>(pos.y);
+	stream.write<uint8_t>(pos.z);
+}
+
+static bool readPosition(PropStream& stream, Position& pos)
+{
+	return stream.read<uint16_t>(pos.x) && stream.read<uint16_t>(pos.y) && stream.read<uint8_t>(pos.z);
+}
+
+void WorldCache::saveItem(PropWriteStream& stream, const Item* item)
+{
+	stream.write<uint16_t>(item->getID());
+
+	// serializeAttr is made for house items, so it leaves out what only the
+	// map sets and doors write nothing at all
+	if (item->getDoor()) {
+		item->Item::serializeAttr(stream);
+	} else {
+		item->serializeAttr(stream);
+	}
+
+	if (!Item::items[item->getID()].moveable) {
+		uint16_t actionId = item->getActionId();
+		if (actionId != 0) {
+			stream.write<uint8_t>(ATTR_ACTION_ID);
+			stream.write<uint16_t>(actionId);
+		}
+	}
+
+	uint16_t uniqueId = item->getUniqueId();
+	if (uniqueId != 0) {
+		stream.write<uint8_t>(ATTR_UNIQUE_ID);
+		stream.write<uint16_t>(uniqueId);
+	}
+
+	if (const Door* door = item->getDoor()) {
+		if (door->getDoorId() != 0) {
+			stream.write<uint8_t>(ATTR_HOUSEDOORID);
+			stream.write<uint8_t>(door->getDoorId());
+		}
+	}
+
+	if (const DepotLocker* depotLocker = dynamic_cast<const DepotLocker*>(item)) {
+		stream.write<uint8_t>(ATTR_DEPOT_ID);
+		stream.write<uint16_t>(depotLocker->getDepotId());
+	}
+
+	if (const Container* container = item->getContainer()) {
+		stream.write<uint8_t>(ATTR_CONTAINER_ITEMS);
+		stream.write<uint32_t>(container->size());
+		for (ItemDeque::const_reverse_iterator it = container->getReversedItems(), end = container->getReversedEnd(); it != end; ++it) {
+			saveItem(stream, *it);
+		}
+	}
+
+	stream.write<uint8_t>(0x00); // attr end
+}
+
+Item* WorldCache::loadItem(PropStream& stream)
+{
+	uint16_t id;
+	if (!stream.read<uint16_t>(id)) {
+		return nullptr;
+	}
+
+	Item* item = Item::CreateItem(id);
+	if (!item) {
+		return nullptr;
+	}
+
+	if (!item->unserializeAttr(stream)) {
+		delete item;
+		return nullptr;
+	}
+
+	if (Container* container = item->getContainer()) {
+		while (container->serializationCount > 0) {
+			Item* containerItem = loadItem(stream);
+			if (!containerItem) {
+				delete item;
+				return nullptr;
+			}
+
+			container->internalAddThing(containerItem);
+			--container->serializationCount;
+		}
+
+		uint8_t endAttr;
+		if (!stream.read<uint8_t>(endAttr) || endAttr != 0) {
+			delete item;
+			return nullptr;
+		}
+	}
+	return item;
+}
+
+// Writes the stream out in pieces and hashes what was written
+class CacheWriter
+{
+	public:
+		explicit CacheWriter(std::ofstream& out) : out(out) {}
+
+		PropWriteStream& getStream() {
+			return stream;
+		}
+
+		void flush(bool force = false) {
+			size_t size;
+			const char* data = stream.getStream(size);
+			if (size == 0 || (!force && size < 1024 * 1024)) {
+				return;
+			}
+
+			out.write(data, size);
+			hash = hashBytes(data, size, hash);
+			stream.clear();
+		}
+
+		uint64_t getHash() const {
+			return hash;
+		}
+
+	private:
+		std::ofstream& out;
+		PropWriteStream stream;
+		uint64_t hash = HASH_OFFSET_BASIS;
+};
+
+bool WorldCache::save(Map& map, const std::string& identifier)
+{
+	int64_t start = OTSYS_TIME();
+
+	const std::string path = getCachePath(identifier);
+	const std::string tmpPath = path + ".tmp";
+
+	std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cout << "[Warning - WorldCache::save] Could not create " << tmpPath << '.' << std::endl;
+		return false;
+	}
+
+	PropWriteStream header;
+	header.write<uint32_t>(WORLD_CACHE_MAGIC);
+	header.write<uint32_t>(version);
+	header.write<uint64_t>(0); // payload hash, filled in at the end
+	header.write<uint64_t>(hashFile(identifier));
+	header.write<uint64_t>(hashFile("data/items/items.otb"));
+	header.write<uint64_t>(hashFile("data/items/items.xml"));
+	header.writeString(map.spawnfile);
+	header.write<uint64_t>(hashFile(map.spawnfile));
+	header.writeString(map.housefile);
+	header.write<uint64_t>(hashFile(map.housefile));
+
+	size_t headerSize;
+	const char* headerData = header.getStream(headerSize);
+	out.write(headerData, headerSize);
+
+	CacheWriter writer(out);
+	PropWriteStream& stream = writer.getStream();
+
+	stream.write<uint16_t>(map.width);
+	stream.write<uint16_t>(map.height);
+
+	const TownMap& towns = map.towns.getTowns();
+	stream.write<uint32_t>(towns.size());
+	for (const auto& it : towns) {
+		const Town* town = it.second;
+		stream.write<uint32_t>(town->getID());
+		stream.writeString(town->getName());
+		writePosition(stream, town->getTemplePosition());
+	}
+
+	stream.write<uint32_t>(map.waypoints.size());
+	for (const auto& it : map.waypoints) {
+		stream.writeString(it.first);
+		writePosition(stream, it.second);
+	}
+
+	uint32_t tileCount = 0;
+	for (const TileBlock& block : map.getTileBlocks()) {
+		for (size_t i = 0; i < block.second; ++i) {
+			if (block.first[i]) {
+				++tileCount;
+			}
+		}
+	}
+
+	stream.write<uint32_t>(tileCount);
+	for (const TileBlock& block : map.getTileBlocks()) {
+		for (size_t i = 0; i < block.second; ++i) {
+			Tile* tile = block.first[i];
+			if (!tile) {
+				continue;
+			}
+
+			writePosition(stream, tile->getPosition());
+
+			uint32_t flags = TILESTATE_NONE;
+			for (tileflags_t flag : {TILESTATE_PROTECTIONZONE, TILESTATE_NOPVPZONE, TILESTATE_PVPZONE, TILESTATE_NOLOGOUT}) {
+				if (tile->hasFlag(flag)) {
+					flags |= flag;
+				}
+			}
+			stream.write<uint32_t>(flags);
+
+			HouseTile* houseTile = dynamic_cast<HouseTile*>(tile);
+			stream.write<uint32_t>(houseTile ? houseTile->getHouse()->getId() : 0);
+
+			// down items are inserted at the front of the list, so they are
+			// written last to first to come back in the same order
+			std::vector<const Item*> items;
+			if (const Item* ground = tile->getGround()) {
+				items.push_back(ground);
+			}
+
+			if (const TileItemVector* tileItems = tile->getItemList()) {
+				items.insert(items.end(), tileItems->getBeginTopItem(), tileItems->getEndTopItem());
+				for (auto it = tileItems->getEndDownItem(), begin = tileItems->getBeginDownItem(); it != begin;) {
+					items.push_back(*--it);
+				}
+			}
+
+			stream.write<uint32_t>(items.size());
+			for (const Item* item : items) {
+				saveItem(stream, item);
+			}
+			writer.flush();
+		}
+	}
+
+	const HouseMap& houses = map.houses.getHouses();
+	stream.write<uint32_t>(houses.size());
+	for (const auto& it : houses) {
+		const House* house = it.second;
+		stream.write<uint32_t>(house->getId());
+		stream.writeString(house->getName());
+		writePosition(stream, house->getEntryPosition());
+		stream.write<uint32_t>(house->getRent());
+		stream.write<uint32_t>(house->getTownId());
+	}
+
+	map.spawns.serialize(stream);
+	writer.flush(true);
+
+	uint64_t payloadHash = writer.getHash();
+	out.seekp(8);
+	out.write(reinterpret_cast<const char*>(&payloadHash), sizeof(payloadHash));
+	out.close();
+
+	if (!out) {
+		std::cout << "[Warning - WorldCache::save] Could not write " << tmpPath << '.' << std::endl;
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+		std::cout << "[Warning - WorldCache::save] Could not rename " << tmpPath << '.' << std::endl;
+		return false;
+	}
+
+	std::cout << "> Saved world cache in: " << (OTSYS_TIME() - start) / (1000.) << " s" << std::endl;
+	return true;
+}
+
+WorldCacheStatus WorldCache::load(Map& map, const std::string& identifier)
+{
+	int64_t start = OTSYS_TIME();
+
+	const std::string path = getCachePath(identifier);
+
+	std::unique_ptr<boost::iostreams::mapped_file_source> file;
+	try {
+		file.reset(new boost::iostreams::mapped_file_source(path));
+	} catch (const std::exception&) {
+		return WORLDCACHE_STALE;
+	}
+
+	PropStream stream;
+	stream.init(file->data(), file->size());
+
+	uint32_t magic, cacheVersion;
+	uint64_t payloadHash, mapHash, otbHash, xmlHash, spawnHash, houseHash;
+	std::string spawnfile, housefile;
+	if (!stream.read<uint32_t>(magic) || magic != WORLD_CACHE_MAGIC ||
+	        !stream.read<uint32_t>(cacheVersion) || cacheVersion != version || !stream.read<uint64_t>(payloadHash) ||
+	        !stream.read<uint64_t>(mapHash) || !stream.read<uint64_t>(otbHash) || !stream.read<uint64_t>(xmlHash) ||
+	        !stream.readString(spawnfile) || !stream.read<uint64_t>(spawnHash) ||
+	        !stream.readString(housefile) || !stream.read<uint64_t>(houseHash)) {
+		std::cout << "> World cache is from another version, loading the map files." << std::endl;
+		return WORLDCACHE_STALE;
+	}
+
+	if (mapHash != hashFile(identifier) || otbHash != hashFile("data/items/items.otb") || xmlHash != hashFile("data/items/items.xml") ||
+	        spawnHash != hashFile(spawnfile) || houseHash != hashFile(housefile)) {
+		std::cout << "> World cache is outdated, loading the map files." << std::endl;
+		return WORLDCACHE_STALE;
+	}
+
+	const char* payload = file->data() + (file->size() - stream.size());
+	if (hashBytes(payload, stream.size()) != payloadHash) {
+		std::cout << "[Warning - WorldCache::load] " << path << " is damaged, loading the map files." << std::endl;
+		return WORLDCACHE_STALE;
+	}
+
+	// from here on the map is being filled, a failure can no longer fall back
+	// to the map files
+	auto fail = [&path](const char* error) {
+		std::cout << "[Error - WorldCache::load] " << error << " Delete " << path << " to load the map files." << std::endl;
+		return WORLDCACHE_ERROR;
+	};
+
+	uint16_t width, height;
+	if (!stream.read<uint16_t>(width) || !stream.read<uint16_t>(height)) {
+		return fail("Could not read the map size.");
+	}
+
+	std::cout << "> Map size: " << width << "x" << height << '.' << std::endl;
+	map.width = width;
+	map.height = height;
+	map.spawnfile = spawnfile;
+	map.housefile = housefile;
+
+	uint32_t count;
+	if (!stream.read<uint32_t>(count)) {
+		return fail("Could not read the towns.");
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t townId;
+		std::string townName;
+		Position templePos;
+		if (!stream.read<uint32_t>(townId) || !stream.readString(townName) || !readPosition(stream, templePos)) {
+			return fail("Could not read the towns.");
+		}
+
+		Town* town = map.towns.getTown(townId);
+		if (!town) {
+			town = new Town(townId);
+			map.towns.addTown(townId, town);
+		}
+
+		town->setName(townName);
+		town->setTemplePos(templePos);
+	}
+
+	if (!stream.read<uint32_t>(count)) {
+		return fail("Could not read the waypoints.");
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		std::string name;
+		Position pos;
+		if (!stream.readString(name) || !readPosition(stream, pos)) {
+			return fail("Could not read the waypoints.");
+		}
+
+		map.waypoints[name] = pos;
+	}
+
+	if (!stream.read<uint32_t>(count)) {
+		return fail("Could not read the tiles.");
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		Position pos;
+		uint32_t flags, houseId, itemCount;
+		if (!readPosition(stream, pos) || !stream.read<uint32_t>(flags) || !stream.read<uint32_t>(houseId) || !stream.read<uint32_t>(itemCount)) {
+			return fail("Could not read a tile.");
+		}
+
+		Tile* tile = nullptr;
+		Item* ground_item = nullptr;
+		if (houseId != 0) {
+			House* house = map.houses.addHouse(houseId);
+			tile = new HouseTile(pos.x, pos.y, pos.z, house);
+			house->addTile(reinterpret_cast<HouseTile*>(tile));
+		}
+
+		for (uint32_t j = 0; j < itemCount; ++j) {
+			Item* item = loadItem(stream);
+			if (!item) {
+				return fail("Could not read a tile item.");
+			}
+
+			if (tile) {
+				tile->internalAddThing(item);
+				item->startDecaying();
+				item->setLoadedFromMap(true);
+			} else if (item->isGroundTile()) {
+				delete ground_item;
+				ground_item = item;
+			} else {
+				tile = IOMap::createTile(ground_item, item, pos.x, pos.y, pos.z);
+				tile->internalAddThing(item);
+				item->startDecaying();
+				item->setLoadedFromMap(true);
+			}
+		}
+
+		if (!tile) {
+			tile = IOMap::createTile(ground_item, nullptr, pos.x, pos.y, pos.z);
+		}
+
+		tile->setFlag(static_cast<tileflags_t>(flags));
+		map.setTile(pos.x, pos.y, pos.z, tile);
+	}
+
+	if (!stream.read<uint32_t>(count)) {
+		return fail("Could not read the houses.");
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t houseId, rent, townId;
+		std::string name;
+		Position entryPos;
+		if (!stream.read<uint32_t>(houseId) || !stream.readString(name) || !readPosition(stream, entryPos) ||
+		        !stream.read<uint32_t>(rent) || !stream.read<uint32_t>(townId)) {
+			return fail("Could not read the houses.");
+		}
+
+		House* house = map.houses.getHouse(houseId);
+		if (!house) {
+			return fail("Unknown house.");
+		}
+
+		house->setName(name);
+		house->setEntryPos(entryPos);
+		house->setRent(rent);
+		house->setTownId(townId);
+		house->setOwner(0, false);
+	}
+
+	// monsters.xml and the npc files are not part of the cache, when one of
+	// the cached spawns is gone only the spawn file has to be read again
+	if (!map.spawns.unserialize(stream, spawnfile)) {
+		std::cout << "> World cache spawns do not match the monster and npc files, loading " << spawnfile << '.' << std::endl;
+		map.spawns.clear();
+		if (!IOMap::loadSpawns(&map)) {
+			return fail("Could not load the spawns.");
+		}
+		save(map, identifier);
+	}
+
+	std::cout << "> World cache loading time: " << (OTSYS_TIME() - start) / (1000.) << " seconds." << std::endl;
+	return WORLDCACHE_LOADED;
+}
@@ -0,0 +1,58 @@
+/**
+ * The Forgotten Server - a free and open-source MMORPG server emulator
+ * Copyright (C) 2015  Mark Samman <mark.samman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef FS_WORLDCACHE_H_229CCDF99884463097936A409EE755E1
+#define FS_WORLDCACHE_H_229CCDF99884463097936A409EE755E1
+
+class Item;
+class Map;
+class PropStream;
+class PropWriteStream;
+
+enum WorldCacheStatus {
+	WORLDCACHE_LOADED,
+	WORLDCACHE_STALE,
+	WORLDCACHE_ERROR,
+};
+
+// Binary snapshot of the loaded map, spawns and houses. It is keyed by
+// hashes of every file it was built from, so it is only used while none of
+// them changed.
+class WorldCache
+{
+	public:
+		/* Restores the map from the cache of the map file
+		 * \returns WORLDCACHE_STALE if there is no usable cache, in that case
+		 * nothing was touched and the map has to be loaded from its files
+		 */
+		static WorldCacheStatus load(Map& map, const std::string& identifier);
+
+		/* Writes the cache of a map that was just loaded from its files,
+		 * before any house items are added from the database
+		 */
+		static bool save(Map& map, const std::string& identifier);
+
+	private:
+		static void saveItem(PropWriteStream& stream, const Item* item);
+		static Item* loadItem(PropStream& stream);
+
+		static const uint32_t version = 2;
+};
+
+#endif